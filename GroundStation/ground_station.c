@@ -0,0 +1,517 @@
+/*
+ * ground_station.c
+ *
+ * Decodes the pressure driver's telemetry (tools/Telemetry.h) from a serial port or a recorded capture,
+ * and writes the samples out as CSV or as a binary columnar file.
+ *
+ *	ground_station [-b baud] [-f csv|columns] [-o output] [-w capture] [-v] input
+ *
+ * input is a file (a capture to replay), a serial device / pseudo-terminal, or - for stdin. Serial devices are
+ * put in raw mode at -b baud (115200 by default) and read until Ctrl-C. -w saves every byte received so a live
+ * session can be replayed later. Output goes to stdout unless -o is given.
+ *
+ * Every frame's CRC is checked by the decoder. Sample, delta, raw and flash log readout frames become rows. Raw frames
+ * are compensated here with the calibration frame the firmware sends alongside them, and are skipped until one has arrived.
+ * Gaps in the sequence numbers are counted as lost frames. A summary, including samples per second of decoding
+ * (disk and serial waits excluded), goes to stderr at the end.
+ *
+ * Columnar output is a series of blocks, each holding up to COLUMN_BLOCK_ROWS rows, all little endian:
+ *	"MSCB" | rows (u32) | sequence (u32 x rows) | timestamp (u32 x rows) | pressure (i32 x rows)
+ *	| temperature (i32 x rows) | flags (u8 x rows) | source frame type (u8 x rows)
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "tools/Telemetry.h"
+#include "tools/DeltaStream.h"
+#include "tools/MS56XXCompensation.h"
+
+#define READ_CHUNK			65536
+#define COLUMN_BLOCK_ROWS	4096
+
+#define FORMAT_CSV			0
+#define FORMAT_COLUMNS		1
+
+typedef struct Row
+{
+	uint32_t sequence; //Frame sequence number, unwrapped past 16 bits
+	uint32_t timestamp;
+	int32_t pressure;
+	int32_t temperature;
+	uint8_t flags;
+	uint8_t source; //TELEMETRY_TYPE_* of the frame it came from
+} Row_t;
+
+typedef struct Output
+{
+	FILE* file;
+	uint8_t format;
+	uint32_t block_rows;
+	uint32_t sequence[COLUMN_BLOCK_ROWS];
+	uint32_t timestamp[COLUMN_BLOCK_ROWS];
+	int32_t pressure[COLUMN_BLOCK_ROWS];
+	int32_t temperature[COLUMN_BLOCK_ROWS];
+	uint8_t flags[COLUMN_BLOCK_ROWS];
+	uint8_t source[COLUMN_BLOCK_ROWS];
+} Output_t;
+
+typedef struct Session
+{
+	TelemetryDecoder_t decoder;
+	DeltaDecoder_t delta;
+	MS56XX_Calibration_t calibration;
+	SENSOR_TYPE model;
+	uint8_t have_calibration;
+	uint8_t have_sequence;
+	uint32_t sequence; //Last one seen, unwrapped
+	uint8_t verbose;
+
+	uint64_t bytes;
+	uint64_t samples;
+	uint64_t lost_frames;
+	uint64_t raw_uncompensated; //Raw samples that arrived before any calibration frame
+	uint64_t malformed; //Frames that passed the CRC but whose payload didn't make sense
+} Session_t;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_signal(int signal_number);
+static double now_seconds(void);
+static int open_input(const char* path, uint32_t baudrate);
+static speed_t baud_constant(uint32_t baudrate);
+static void output_row(Output_t* output, const Row_t* row);
+static void output_flush(Output_t* output);
+static void put_le32_array(FILE* file, const uint32_t* values, uint32_t count);
+static uint32_t unwrap_sequence(Session_t* session, uint16_t sequence);
+static void handle_frame(Session_t* session, Output_t* output, const TelemetryFrame_t* frame);
+static void usage(const char* name);
+
+
+static void handle_signal(int signal_number)
+{
+	(void)signal_number;
+	stop_requested = 1;
+}
+
+static double now_seconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static speed_t baud_constant(uint32_t baudrate)
+//Returns 0 for rates termios has no constant for
+{
+	switch (baudrate)
+	{
+		case 9600: return B9600;
+		case 19200: return B19200;
+		case 38400: return B38400;
+		case 57600: return B57600;
+		case 115200: return B115200;
+		case 230400: return B230400;
+		case 460800: return B460800;
+		case 500000: return B500000;
+		case 921600: return B921600;
+		case 1000000: return B1000000;
+		case 2000000: return B2000000;
+		default: return 0;
+	}
+}
+
+static int open_input(const char* path, uint32_t baudrate)
+/*	Opens a capture file, or a serial device in raw mode at baudrate
+	Returns the file descriptor, or -1 with a message already printed
+*/
+{
+	int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY | O_NOCTTY);
+	if (fd < 0)
+	{
+		fprintf(stderr, "Can't open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	if (!isatty(fd))
+		return fd;
+
+	struct termios settings;
+	speed_t speed = baud_constant(baudrate);
+	if (speed == 0)
+	{
+		fprintf(stderr, "Unsupported baud rate %" PRIu32 "\n", baudrate);
+		return -1;
+	}
+	if (tcgetattr(fd, &settings) != 0)
+	{
+		fprintf(stderr, "Can't configure %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	cfmakeraw(&settings);
+	cfsetispeed(&settings, speed);
+	cfsetospeed(&settings, speed);
+	settings.c_cflag |= CLOCAL | CREAD;
+	settings.c_cc[VMIN] = 1;
+	settings.c_cc[VTIME] = 0;
+	if (tcsetattr(fd, TCSANOW, &settings) != 0)
+	{
+		fprintf(stderr, "Can't configure %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	return fd;
+}
+
+static void put_le32_array(FILE* file, const uint32_t* values, uint32_t count)
+//Writes values little endian whatever the host is
+{
+	uint8_t bytes[4 * 256];
+	while (count)
+	{
+		uint32_t chunk = count < 256 ? count : 256;
+		for (uint32_t i = 0; i < chunk; i++)
+			telemetry_put_u32(&bytes[4 * i], values[i]);
+		fwrite(bytes, 4, chunk, file);
+		values += chunk;
+		count -= chunk;
+	}
+}
+
+static void output_flush(Output_t* output)
+//Writes out the rows held for the current column block, if any
+{
+	if (output->format != FORMAT_COLUMNS || output->block_rows == 0)
+		return;
+	uint8_t header[8] = {'M', 'S', 'C', 'B'};
+	telemetry_put_u32(&header[4], output->block_rows);
+	fwrite(header, 1, sizeof(header), output->file);
+	put_le32_array(output->file, output->sequence, output->block_rows);
+	put_le32_array(output->file, output->timestamp, output->block_rows);
+	put_le32_array(output->file, (const uint32_t*)output->pressure, output->block_rows);
+	put_le32_array(output->file, (const uint32_t*)output->temperature, output->block_rows);
+	fwrite(output->flags, 1, output->block_rows, output->file);
+	fwrite(output->source, 1, output->block_rows, output->file);
+	output->block_rows = 0;
+}
+
+static void output_row(Output_t* output, const Row_t* row)
+{
+	if (output->format == FORMAT_CSV)
+	{
+		fprintf(output->file, "%" PRIu32 ",%" PRIu32 ",%" PRIi32 ",%" PRIi32 ",%u,%u\n", row->sequence, row->timestamp,
+				row->pressure, row->temperature, (row->flags & TELEMETRY_FLAG_VALID) ? 1 : 0, row->source);
+		return;
+	}
+	uint32_t i = output->block_rows;
+	output->sequence[i] = row->sequence;
+	output->timestamp[i] = row->timestamp;
+	output->pressure[i] = row->pressure;
+	output->temperature[i] = row->temperature;
+	output->flags[i] = row->flags;
+	output->source[i] = row->source;
+	if (++output->block_rows == COLUMN_BLOCK_ROWS)
+		output_flush(output);
+}
+
+static uint32_t unwrap_sequence(Session_t* session, uint16_t sequence)
+/*	Extends a frame's 16 bit sequence number and counts the frames missing since the last one
+	A jump backwards is taken as the firmware restarting, not as 65000 lost frames
+*/
+{
+	if (!session->have_sequence)
+	{
+		session->have_sequence = 1;
+		session->sequence = sequence;
+		return session->sequence;
+	}
+	uint16_t step = sequence - (uint16_t)session->sequence;
+	if (step == 0 || step >= 0x8000)
+	{
+		if (session->verbose)
+			fprintf(stderr, "Sequence went from %u to %u, resynchronising\n", (uint16_t)session->sequence, sequence);
+		session->sequence = (session->sequence & ~(uint32_t)0xFFFF) | sequence;
+		return session->sequence;
+	}
+	session->lost_frames += step - 1;
+	session->sequence += step;
+	return session->sequence;
+}
+
+static void handle_frame(Session_t* session, Output_t* output, const TelemetryFrame_t* frame)
+{
+	Row_t row = {.sequence = unwrap_sequence(session, frame->sequence), .source = frame->type};
+	TelemetrySample_t sample;
+
+	switch (frame->type)
+	{
+		case TELEMETRY_TYPE_SAMPLE:
+			if (telemetry_parse_sample(frame, &sample))
+			{
+				session->malformed++;
+				return;
+			}
+			row.timestamp = sample.timestamp;
+			row.pressure = sample.pressure;
+			row.temperature = sample.temperature;
+			row.flags = sample.flags;
+			output_row(output, &row);
+			session->samples++;
+			return;
+
+		case TELEMETRY_TYPE_DELTA:
+		{
+			//Every frame starts with a keyframe, so a lost frame doesn't spoil the next one
+			uint8_t offset = 0;
+			delta_decoder_init(&session->delta);
+			while (offset < frame->length)
+			{
+				uint8_t used = delta_decode_sample(&session->delta, &frame->payload[offset], frame->length - offset, &row.pressure, &row.temperature);
+				if (used == 0 || !session->delta.have_keyframe)
+				{
+					session->malformed++;
+					return;
+				}
+				offset += used;
+				row.flags = TELEMETRY_FLAG_VALID;
+				output_row(output, &row);
+				session->samples++;
+			}
+			return;
+		}
+
+		case TELEMETRY_TYPE_CALIBRATION:
+			if (frame->length < 13)
+			{
+				session->malformed++;
+				return;
+			}
+			session->model = frame->payload[0];
+			session->calibration.SENSt1 = telemetry_get_u16(&frame->payload[1]);
+			session->calibration.OFFt1 = telemetry_get_u16(&frame->payload[3]);
+			session->calibration.TCS = telemetry_get_u16(&frame->payload[5]);
+			session->calibration.TCO = telemetry_get_u16(&frame->payload[7]);
+			session->calibration.Tref = telemetry_get_u16(&frame->payload[9]);
+			session->calibration.TEMPSENS = telemetry_get_u16(&frame->payload[11]);
+			session->have_calibration = 1;
+			return;
+
+		case TELEMETRY_TYPE_RAW:
+			if (frame->length < 13)
+			{
+				session->malformed++;
+				return;
+			}
+			if (!session->have_calibration)
+			{
+				session->raw_uncompensated++;
+				return;
+			}
+			row.timestamp = telemetry_get_u32(&frame->payload[0]);
+			row.flags = frame->payload[12];
+			if (MS56XX_compensate(&session->calibration, session->model, telemetry_get_u32(&frame->payload[4]),
+					telemetry_get_u32(&frame->payload[8]), &row.pressure, &row.temperature))
+			{
+				session->malformed++;
+				return;
+			}
+			output_row(output, &row);
+			session->samples++;
+			return;
+
+		case TELEMETRY_TYPE_LOG:
+		{
+			//Flash log readout (firmware command L1). Samples are packed back to back after the position
+			if (frame->length < 4 || (frame->length - 4) % TELEMETRY_SAMPLE_PAYLOAD_LENGTH != 0)
+			{
+				session->malformed++;
+				return;
+			}
+			if (frame->length == 4 && session->verbose)
+				fprintf(stderr, "End of flash log\n");
+			for (uint8_t offset = 4; offset < frame->length; offset += TELEMETRY_SAMPLE_PAYLOAD_LENGTH)
+			{
+				telemetry_get_sample(&frame->payload[offset], &sample);
+				row.timestamp = sample.timestamp;
+				row.pressure = sample.pressure;
+				row.temperature = sample.temperature;
+				row.flags = sample.flags;
+				output_row(output, &row);
+				session->samples++;
+			}
+			return;
+		}
+
+		case TELEMETRY_TYPE_ACK:
+			if (session->verbose && frame->length >= 2)
+				fprintf(stderr, "Command %c %s\n", frame->payload[0], frame->payload[1] ? "rejected" : "applied");
+			return;
+
+		case TELEMETRY_TYPE_STATUS:
+			if (session->verbose && frame->length >= 16)
+				fprintf(stderr, "Status: up %" PRIu32 " ms, %" PRIu32 " receive overruns, %" PRIu32 " samples and %" PRIu32 " status frames dropped\n",
+						telemetry_get_u32(&frame->payload[0]), telemetry_get_u32(&frame->payload[4]),
+						telemetry_get_u32(&frame->payload[8]), telemetry_get_u32(&frame->payload[12]));
+			if (session->verbose && frame->length >= 18)
+				fprintf(stderr, "CPU awake %u%% of the last sample, %u%% overall\n", frame->payload[16], frame->payload[17]);
+			if (session->verbose && frame->length >= 22)
+				fprintf(stderr, "%" PRIu32 " samples started later than the firmware's latency budget\n", telemetry_get_u32(&frame->payload[18]));
+			if (session->verbose && frame->length >= 34)
+				fprintf(stderr, "Pressure over the last samples: mean %" PRIi32 ", min %" PRIi32 ", max %" PRIi32 " Pa\n",
+						(int32_t)telemetry_get_u32(&frame->payload[22]), (int32_t)telemetry_get_u32(&frame->payload[26]),
+						(int32_t)telemetry_get_u32(&frame->payload[30]));
+			if (session->verbose && frame->length >= 38)
+				fprintf(stderr, "%" PRIu32 " bytes lost to transmit DMA errors\n", telemetry_get_u32(&frame->payload[34]));
+			return;
+
+		case TELEMETRY_TYPE_TASK:
+		{
+			//Answer to the T0 command, one frame per main loop task
+			if (frame->length < 25)
+			{
+				session->malformed++;
+				return;
+			}
+			uint32_t runs = telemetry_get_u32(&frame->payload[1]);
+			uint64_t total = ((uint64_t)telemetry_get_u32(&frame->payload[17]) << 32) | telemetry_get_u32(&frame->payload[13]);
+			fprintf(stderr, "Task %-12.*s %10" PRIu32 " runs %8" PRIu32 " overruns %8" PRIu32 " us max %10.1f us mean %8" PRIu32 " us max late\n",
+					frame->length - 25, (const char*)&frame->payload[25], runs, telemetry_get_u32(&frame->payload[5]),
+					telemetry_get_u32(&frame->payload[9]), runs ? (double)total / runs : 0.0, telemetry_get_u32(&frame->payload[21]));
+			return;
+		}
+
+		case TELEMETRY_TYPE_PROFILE:
+		{
+			//Answer to the Q0 command on DEBUG firmware, one frame per region
+			if (frame->length < 21)
+			{
+				session->malformed++;
+				return;
+			}
+			uint32_t runs = telemetry_get_u32(&frame->payload[1]);
+			uint64_t total = ((uint64_t)telemetry_get_u32(&frame->payload[17]) << 32) | telemetry_get_u32(&frame->payload[13]);
+			fprintf(stderr, "Profile %-16.*s %10" PRIu32 " runs %10" PRIu32 " min %10" PRIu32 " max %12.1f mean cycles\n",
+					frame->length - 21, (const char*)&frame->payload[21], runs,
+					telemetry_get_u32(&frame->payload[5]), telemetry_get_u32(&frame->payload[9]),
+					runs ? (double)total / runs : 0.0);
+			return;
+		}
+
+		default:
+			if (session->verbose)
+				fprintf(stderr, "Unknown frame type 0x%02x\n", frame->type);
+			return;
+	}
+}
+
+static void usage(const char* name)
+{
+	fprintf(stderr, "Usage: %s [-b baud] [-f csv|columns] [-o output] [-w capture] [-v] input\n", name);
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t baudrate = 115200;
+	const char* output_path = NULL;
+	const char* capture_path = NULL;
+	static Output_t output = {.format = FORMAT_CSV};
+	static Session_t session;
+	int option;
+
+	while ((option = getopt(argc, argv, "b:f:o:w:v")) != -1)
+	{
+		switch (option)
+		{
+			case 'b': baudrate = strtoul(optarg, NULL, 10); break;
+			case 'f':
+				if (strcmp(optarg, "csv") == 0)
+					output.format = FORMAT_CSV;
+				else if (strcmp(optarg, "columns") == 0)
+					output.format = FORMAT_COLUMNS;
+				else
+				{
+					usage(argv[0]);
+					return 2;
+				}
+				break;
+			case 'o': output_path = optarg; break;
+			case 'w': capture_path = optarg; break;
+			case 'v': session.verbose = 1; break;
+			default:
+				usage(argv[0]);
+				return 2;
+		}
+	}
+	if (optind != argc - 1)
+	{
+		usage(argv[0]);
+		return 2;
+	}
+
+	int fd = open_input(argv[optind], baudrate);
+	if (fd < 0)
+		return 1;
+	output.file = output_path ? fopen(output_path, "wb") : stdout;
+	FILE* capture = capture_path ? fopen(capture_path, "wb") : NULL;
+	if (!output.file || (capture_path && !capture))
+	{
+		fprintf(stderr, "Can't open %s: %s\n", !output.file ? output_path : capture_path, strerror(errno));
+		return 1;
+	}
+
+	//No SA_RESTART, so a blocked read on a serial port returns when Ctrl-C is pressed
+	struct sigaction action = {.sa_handler = handle_signal};
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	if (output.format == FORMAT_CSV)
+		fprintf(output.file, "sequence,timestamp,pressure,temperature,valid,source\n");
+	telemetry_decoder_init(&session.decoder);
+
+	static uint8_t chunk[READ_CHUNK];
+	TelemetryFrame_t frame;
+	double decode_time = 0;
+	ssize_t length;
+	while (!stop_requested && (length = read(fd, chunk, sizeof(chunk))) != 0)
+	{
+		if (length < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "Read failed: %s\n", strerror(errno));
+			break;
+		}
+		if (capture)
+			fwrite(chunk, 1, length, capture);
+
+		double start = now_seconds();
+		for (ssize_t i = 0; i < length; i++)
+		{
+			if (telemetry_decoder_push(&session.decoder, chunk[i], &frame))
+				handle_frame(&session, &output, &frame);
+		}
+		decode_time += now_seconds() - start;
+		session.bytes += length;
+	}
+	output_flush(&output);
+
+	if (capture)
+		fclose(capture);
+	if (output.file != stdout)
+		fclose(output.file);
+	if (fd != STDIN_FILENO)
+		close(fd);
+
+	fprintf(stderr, "%" PRIu64 " bytes, %" PRIu32 " good frames, %" PRIu32 " bad frames, %" PRIu64 " lost frames, %" PRIu64 " malformed payloads\n",
+			session.bytes, session.decoder.good_frames, session.decoder.bad_frames, session.lost_frames, session.malformed);
+	if (session.raw_uncompensated)
+		fprintf(stderr, "%" PRIu64 " raw samples skipped before the first calibration frame\n", session.raw_uncompensated);
+	fprintf(stderr, "%" PRIu64 " samples decoded in %.3f s (%.0f samples/s)\n", session.samples, decode_time,
+			decode_time > 0 ? session.samples / decode_time : 0.0);
+	return 0;
+}
@@ -0,0 +1,19 @@
+/*
+ * test_tools.c
+ *
+ * Runs the DEBUG self tests of the firmware modules that build on the host, so they can be checked without a board.
+ * Built and run by make test. Exits non-zero if any test failed.
+ */
+
+#include "tools/Telemetry.h"
+#include "tools/TaskScheduler.h"
+#include "tools/TelemetryScheduler.h"
+
+int main(void)
+{
+	uint8_t failed = 0;
+	failed |= test_telemetry();
+	failed |= test_task_scheduler();
+	failed |= test_telemetry_scheduler();
+	return failed;
+}
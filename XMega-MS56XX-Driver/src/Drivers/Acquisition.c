@@ -0,0 +1,283 @@
+/*
+ * Acquisition.c
+ *
+ * Timer driven MS56XX reads. See Acquisition.h
+ */
+
+#include "drivers/Acquisition.h"
+#include "drivers/Timebase.h"
+
+#define MAX_LATENCY_TICKS	(ACQUISITION_MAX_LATENCY_US * TIMEBASE_TICKS_PER_US)
+
+enum {
+	STATE_IDLE,
+	STATE_PRESSURE, //D1 converting
+	STATE_TEMPERATURE //D2 converting
+};
+
+static MS56XX_t* sensor = NULL;
+static uint8_t D1_cmd, D2_cmd;
+static uint16_t delay_time; //us per conversion
+static uint16_t segments = 1; //Period timer overflows per sample
+static uint16_t segment = 0;
+static uint32_t segment_ticks; //Timebase ticks per period timer overflow
+static uint64_t last_overflow_ticks; //timebase_ticks() at the last period timer overflow the interrupt saw
+
+static volatile uint8_t state = STATE_IDLE;
+static uint64_t trigger_ticks; //timebase_ticks() when this sample's period started
+static uint16_t busy_ticks; //Spent in the interrupts for this sample
+static MS56XX_Data_t converting; //Filled in by the interrupts
+
+static MS56XX_Data_t finished;
+static volatile uint8_t have_finished = 0;
+static volatile uint32_t overruns = 0;
+static volatile uint16_t max_latency = 0; //Ticks from a period overflow to its D1 command
+static volatile uint32_t late_samples = 0;
+
+ISR(ACQUISITION_PERIOD_OVF_vect)
+{
+	uint16_t previous_segment = segment;
+	if (++segment >= segments)
+		segment = 0;
+	
+	//The conversion goes out first, so the latency budget (conf_interrupts.h) only has to cover getting here
+	uint8_t starting = segment == 0 && state == STATE_IDLE;
+	if (starting)
+		MS56XX_command(sensor, D1_cmd);
+	
+	//Restarted by this overflow through the event system, so this is how long ago it was. Read straight before the
+	//timebase, so the two are the same instant to within a few cycles
+	uint16_t since_trigger = ACQUISITION_CONVERSION_TC.CNT;
+	uint64_t now = timebase_ticks();
+	uint64_t overflow_ticks = now - since_trigger;
+	
+	//A flash page erase or write can hold this interrupt off past whole overflows. Count the samples those periods lost
+	//as late, and put the samples back on their phase. With long periods that can make this overflow a sample's after all,
+	//which is left to the next one, or not, in which case the sample just started stands
+	uint32_t gap = (uint32_t)(overflow_ticks - last_overflow_ticks);
+	last_overflow_ticks = overflow_ticks;
+	if (gap > segment_ticks + segment_ticks / 2)
+	{
+		uint32_t missed = (gap + segment_ticks / 2) / segment_ticks - 1;
+		late_samples += (previous_segment + missed) / segments;
+		segment = (previous_segment + missed + 1) % segments;
+		if (segment == 0 && !starting && state == STATE_IDLE)
+			late_samples++;
+	}
+	
+	if (!starting)
+	{
+		if (segment == 0 && state != STATE_IDLE)
+			overruns++; //Only after the conversion interrupts were held off too; acquisition_fits leaves room for both conversions
+		return;
+	}
+	
+	ACQUISITION_CONVERSION_TC.CCA = since_trigger + delay_time * TIMEBASE_TICKS_PER_US;
+	ACQUISITION_CONVERSION_TC.INTFLAGS = TC1_CCAIF_bm;
+	ACQUISITION_CONVERSION_TC.INTCTRLB = ACQUISITION_CCA_INTLVL;
+	state = STATE_PRESSURE;
+	
+	//The deadline from conf_interrupts.h. since_trigger was read just after the D1 command went out
+	if (since_trigger > max_latency)
+		max_latency = since_trigger;
+	if (since_trigger > MAX_LATENCY_TICKS)
+		late_samples++;
+	
+	trigger_ticks = overflow_ticks;
+	converting.timestamp = (uint32_t)(now / TIMEBASE_TICKS_PER_US) + delay_time / 2;
+	busy_ticks = ACQUISITION_CONVERSION_TC.CNT - since_trigger; //From the D1 command on; getting here is in the latency instead
+}
+
+ISR(ACQUISITION_CONVERSION_CCA_vect)
+//D1 done
+{
+	uint16_t entry = ACQUISITION_CONVERSION_TC.CNT;
+	converting.raw_pressure = MS56XX_read_adc(sensor);
+	MS56XX_command(sensor, D2_cmd);
+	ACQUISITION_CONVERSION_TC.CCB = ACQUISITION_CONVERSION_TC.CNT + delay_time * TIMEBASE_TICKS_PER_US;
+	ACQUISITION_CONVERSION_TC.INTFLAGS = TC1_CCBIF_bm;
+	ACQUISITION_CONVERSION_TC.INTCTRLB = ACQUISITION_CCB_INTLVL;
+	state = STATE_TEMPERATURE;
+	busy_ticks += ACQUISITION_CONVERSION_TC.CNT - entry;
+}
+
+ISR(ACQUISITION_CONVERSION_CCB_vect)
+//D2 done
+{
+	uint16_t entry = ACQUISITION_CONVERSION_TC.CNT;
+	converting.raw_temperature = MS56XX_read_adc(sensor);
+	ACQUISITION_CONVERSION_TC.INTCTRLB = TC_CCAINTLVL_OFF_gc | TC_CCBINTLVL_OFF_gc;
+	state = STATE_IDLE;
+	busy_ticks += ACQUISITION_CONVERSION_TC.CNT - entry;
+	
+	//Wall time from the timebase; the conversion timer wraps during the slowest pair of conversions
+	uint32_t elapsed = (uint32_t)(timebase_ticks() - trigger_ticks);
+	converting.active_percent = elapsed ? (uint8_t)((uint32_t)busy_ticks * 100 / elapsed) : 100;
+	finished = converting;
+	have_finished = 1; //An unread sample is replaced; acquisition_read only ever sees the newest
+}
+
+uint8_t acquisition_fits(OSR_Settings osr, uint16_t period_ms)
+//1 if both conversions at osr, and the margin around them, fit in period_ms
+{
+	uint8_t D1, D2;
+	uint16_t delay;
+	if (get_read_info(osr, &D1, &D2, &delay) || period_ms == 0)
+		return 0;
+	return 2UL * delay + ACQUISITION_MARGIN_US <= period_ms * 1000UL;
+}
+
+uint8_t acquisition_start(MS56XX_t* new_sensor, uint16_t period_ms)
+/*	Starts reading new_sensor (already calibrated) every period_ms, at its osr. The first conversion starts one period from now
+	Return values
+	* 0 - running
+	* 1 - acquisition_fits says no, acquisition is left stopped
+*/
+{
+	acquisition_stop();
+	if (!acquisition_fits(new_sensor->osr, period_ms))
+		return 1;
+	get_read_info(new_sensor->osr, &D1_cmd, &D2_cmd, &delay_time);
+	sensor = new_sensor;
+	
+	/*	Long periods are split into equal segments that fit the 16 bit period timer. The divisors of 500 are never more than
+		twice apart, so a segment is never under a quarter of 65536 ticks (32 ms): longer than the slowest pair of conversions,
+		so the overflows in between only ever restart the conversion timer while nothing is converting
+	*/
+	uint32_t period_ticks = (uint32_t)period_ms * ACQUISITION_PERIOD_TICKS_PER_MS;
+	segments = (period_ticks + 0xFFFF) / 0x10000;
+	while (period_ticks % segments)
+		segments++;
+	segment = 0;
+	segment_ticks = (period_ticks / segments) * (TIMEBASE_TICKS_PER_US * 1000UL / ACQUISITION_PERIOD_TICKS_PER_MS);
+	
+	sysclk_enable_peripheral_clock(&ACQUISITION_PERIOD_TC);
+	sysclk_enable_peripheral_clock(&ACQUISITION_CONVERSION_TC);
+	sysclk_enable_peripheral_clock(&EVSYS);
+	
+	ACQUISITION_EVENT_MUX = ACQUISITION_EVENT_SOURCE;
+	ACQUISITION_CONVERSION_TC.PER = 0xFFFF;
+	ACQUISITION_CONVERSION_TC.CTRLD = TC_EVACT_RESTART_gc | ACQUISITION_EVENT_SELECT;
+	ACQUISITION_CONVERSION_TC.CTRLA = ACQUISITION_CONVERSION_PRESCALER;
+	
+	ACQUISITION_PERIOD_TC.PER = period_ticks / segments - 1;
+	ACQUISITION_PERIOD_TC.CNT = 0;
+	ACQUISITION_PERIOD_TC.INTFLAGS = TC0_OVFIF_bm;
+	ACQUISITION_PERIOD_TC.INTCTRLA = ACQUISITION_OVF_INTLVL;
+	pmic_enable_level(ACQUISITION_PMIC_LEVEL);
+	last_overflow_ticks = timebase_ticks();
+	ACQUISITION_PERIOD_TC.CTRLA = ACQUISITION_PERIOD_PRESCALER;
+	return 0;
+}
+
+void acquisition_stop(void)
+//Abandons any conversion in progress. Safe to call when not running
+{
+	ACQUISITION_PERIOD_TC.CTRLA = TC_CLKSEL_OFF_gc;
+	ACQUISITION_PERIOD_TC.INTCTRLA = TC_OVFINTLVL_OFF_gc;
+	ACQUISITION_CONVERSION_TC.INTCTRLB = TC_CCAINTLVL_OFF_gc | TC_CCBINTLVL_OFF_gc;
+	ACQUISITION_CONVERSION_TC.CTRLA = TC_CLKSEL_OFF_gc;
+	state = STATE_IDLE;
+	have_finished = 0;
+}
+
+uint8_t acquisition_read(MS56XX_t* dest)
+/*	Copies the newest finished sample into dest->data and compensates it with dest's calibration
+	Return values
+	* 0 - nothing new since the last call, dest untouched
+	* 1 - dest->data is a new sample
+*/
+{
+	if (!have_finished)
+		return 0;
+	
+	irqflags_t flags = cpu_irq_save();
+	MS56XX_Data_t data = finished;
+	have_finished = 0;
+	cpu_irq_restore(flags);
+	
+	data.valid = !MS56XX_compensate(&dest->calibration, dest->model, data.raw_pressure, data.raw_temperature, &data.pressure, &data.temperature);
+	dest->data = data;
+	return 1;
+}
+
+uint32_t acquisition_overruns(void)
+//Sample periods skipped because the last sample was still converting. Periods lost to a stall count in acquisition_late_samples
+{
+	irqflags_t flags = cpu_irq_save();
+	uint32_t count = overruns;
+	cpu_irq_restore(flags);
+	return count;
+}
+
+uint16_t acquisition_max_latency(void)
+//Longest time in us from a period overflow to its D1 command since the last acquisition_reset_latency
+{
+	irqflags_t flags = cpu_irq_save();
+	uint16_t latency = max_latency;
+	cpu_irq_restore(flags);
+	return latency / TIMEBASE_TICKS_PER_US;
+}
+
+uint32_t acquisition_late_samples(void)
+/*	Samples whose D1 command went out later than ACQUISITION_MAX_LATENCY_US, and samples never started because the
+	period interrupt was held off (by flash writes) until a later period
+*/
+{
+	irqflags_t flags = cpu_irq_save();
+	uint32_t count = late_samples;
+	cpu_irq_restore(flags);
+	return count;
+}
+
+void acquisition_reset_latency(void)
+{
+	irqflags_t flags = cpu_irq_save();
+	max_latency = 0;
+	late_samples = 0;
+	cpu_irq_restore(flags);
+}
+
+//----------------Test functions------------------------
+
+#ifdef DEBUG
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include "drivers/uart_tools.h"
+
+void test_acquisition_deadlines(MS56XX_t* test_sensor, uint16_t seconds)
+/*	Reads test_sensor as fast as its OSR allows while keeping the UART transmit queue full, so the telemetry interrupts
+	never get a rest, then prints whether every conversion started within ACQUISITION_MAX_LATENCY_US
+	Call after UART_tx_interrupt_init or UART_tx_dma_init. Leaves acquisition stopped
+*/
+{
+	uint8_t filler[32];
+	memset(filler, 'U', sizeof(filler));
+	
+	uint16_t period_ms = 1;
+	while (!acquisition_fits(test_sensor->osr, period_ms))
+		period_ms++;
+	
+	uint32_t samples = 0;
+	uint32_t overruns_before = acquisition_overruns();
+	uint32_t rx_overruns_before = UART_rx_overruns();
+	acquisition_start(test_sensor, period_ms);
+	acquisition_reset_latency();
+	uint32_t end_ms = timebase_ms() + seconds * 1000UL;
+	while ((int32_t)(timebase_ms() - end_ms) < 0)
+	{
+		UART_write(filler, sizeof(filler));
+		samples += acquisition_read(test_sensor);
+	}
+	acquisition_stop();
+	UART_tx_flush();
+	
+	uint32_t expected = seconds * 1000UL / period_ms;
+	uint32_t late = acquisition_late_samples();
+	uint32_t skipped = acquisition_overruns() - overruns_before;
+	printf("\n%" PRIu32 " of %" PRIu32 " samples every %u ms, worst start latency %u us (budget %u), %" PRIu32 " late, %" PRIu32 " skipped, %" PRIu32 " receive overruns: %s\n",
+			samples, expected, period_ms, acquisition_max_latency(), ACQUISITION_MAX_LATENCY_US, late, skipped,
+			UART_rx_overruns() - rx_overruns_before, (late == 0 && skipped == 0 && samples + 1 >= expected) ? "PASS" : "FAIL");
+}
+#endif
@@ -0,0 +1,44 @@
+/*
+ * Acquisition.h
+ *
+ * Reads an MS56XX at a fixed period from high level interrupts (conf_interrupts.h), so sample timing doesn't depend on what
+ * the main loop or the telemetry interrupts are doing.
+ *
+ * ACQUISITION_PERIOD_TC overflows once per sample period (or a whole number of times, for periods longer than it can count).
+ * Its overflow interrupt sends the D1 command straight away. The same overflow restarts ACQUISITION_CONVERSION_TC through the
+ * event system, so the conversion timer's count is exactly how long ago the sample period started, whatever the interrupt
+ * latency was. Its compare interrupts read D1 and start D2, then read D2, each at the conversion deadline.
+ *
+ * The event system can't write to the SPI, so the conversion itself still starts when the overflow interrupt runs, and the
+ * sample timestamp moves with that interrupt's latency. Mostly that's the few microseconds budgeted in conf_interrupts.h,
+ * but a flash page erase or write (drivers/FlashLog.h) stalls the CPU, interrupts included, for milliseconds. A start
+ * held off past ACQUISITION_MAX_LATENCY_US, or past whole periods, is counted by acquisition_late_samples.
+ *
+ * The compensation math stays in the main loop: acquisition_read picks up finished samples.
+ * The sensor's SPI belongs to the interrupts while acquisition is running, so stop it before calibrating or calling readMS56XX.
+ */
+
+
+#ifndef ACQUISITION_H_
+#define ACQUISITION_H_
+
+#include <asf.h>
+#include "drivers/MS56XX.h"
+#include "config/conf_acquisition.h"
+#include "config/conf_interrupts.h"
+
+uint8_t acquisition_fits(OSR_Settings osr, uint16_t period_ms);
+uint8_t acquisition_start(MS56XX_t* sensor, uint16_t period_ms);
+void acquisition_stop(void);
+uint8_t acquisition_read(MS56XX_t* sensor);
+uint32_t acquisition_overruns(void);
+uint16_t acquisition_max_latency(void);
+uint32_t acquisition_late_samples(void);
+void acquisition_reset_latency(void);
+
+//-------For testing/debugging-----------
+#ifdef DEBUG
+void test_acquisition_deadlines(MS56XX_t* test_sensor, uint16_t seconds);
+#endif
+
+#endif /* ACQUISITION_H_ */
@@ -0,0 +1,112 @@
+/*
+ * ConfigStore.c
+ *
+ * Wear-levelled key-value settings in EEPROM. See ConfigStore.h
+ */
+
+#include "drivers/ConfigStore.h"
+#include "drivers/EEPROMCache.h"
+#include "tools/Telemetry.h"
+
+#if (CONFIG_STORE_START % CONFIG_RECORD_LENGTH) != 0 || (EEPROM_PAGE_SIZE % CONFIG_RECORD_LENGTH) != 0
+#error "Config store records must not straddle EEPROM pages"
+#endif
+
+#define NO_SLOT		0xFF
+
+static uint32_t values[CONFIG_STORE_MAX_KEYS];
+static uint8_t live_slot[CONFIG_STORE_MAX_KEYS]; //Slot holding each key's current record, or NO_SLOT if it has none
+static uint32_t last_sequence = 0;
+static uint8_t next_slot = 0;
+
+static uint8_t slot_is_live(uint8_t slot);
+
+
+static uint8_t slot_is_live(uint8_t slot)
+{
+	for (uint8_t key = 0; key < CONFIG_STORE_MAX_KEYS; key++)
+	{
+		if (live_slot[key] == slot)
+			return 1;
+	}
+	return 0;
+}
+
+void config_store_init(void)
+//Reads back the stored settings. One pass over every slot
+{
+	uint8_t record[CONFIG_RECORD_LENGTH];
+	uint32_t sequences[CONFIG_STORE_MAX_KEYS];
+	uint8_t newest_slot = NO_SLOT;
+	
+	last_sequence = 0;
+	for (uint8_t key = 0; key < CONFIG_STORE_MAX_KEYS; key++)
+		live_slot[key] = NO_SLOT;
+	
+	for (uint8_t slot = 0; slot < CONFIG_STORE_SLOTS; slot++)
+	{
+		eecache_read_buffer(CONFIG_STORE_START + slot * CONFIG_RECORD_LENGTH, record, CONFIG_RECORD_LENGTH);
+		uint8_t key = record[1];
+		uint32_t sequence = telemetry_get_u32(&record[2]);
+		if (record[0] != CONFIG_STORE_VERSION || key >= CONFIG_STORE_MAX_KEYS
+				|| crc16_ccitt_update(0xFFFF, record, CONFIG_RECORD_LENGTH - 2) != telemetry_get_u16(&record[CONFIG_RECORD_LENGTH - 2]))
+			continue;
+		
+		if (live_slot[key] == NO_SLOT || sequence > sequences[key])
+		{
+			live_slot[key] = slot;
+			sequences[key] = sequence;
+			values[key] = telemetry_get_u32(&record[6]);
+		}
+		if (newest_slot == NO_SLOT || sequence > last_sequence)
+		{
+			newest_slot = slot;
+			last_sequence = sequence;
+		}
+	}
+	next_slot = newest_slot == NO_SLOT ? 0 : (newest_slot + 1) % CONFIG_STORE_SLOTS;
+}
+
+uint8_t config_store_get(uint8_t key, uint32_t* value)
+/*	Return values
+	* 0 - *value is the stored setting
+	* 1 - nothing stored for this key (or it's out of range), *value untouched
+*/
+{
+	if (key >= CONFIG_STORE_MAX_KEYS || live_slot[key] == NO_SLOT)
+		return 1;
+	*value = values[key];
+	return 0;
+}
+
+uint8_t config_store_set(uint8_t key, uint32_t value)
+/*	Stores a setting. It's in EEPROM by the time this returns (a few milliseconds), unless the value was already stored
+	Return values
+	* 0 - success
+	* 1 - key out of range
+*/
+{
+	if (key >= CONFIG_STORE_MAX_KEYS)
+		return 1;
+	if (live_slot[key] != NO_SLOT && values[key] == value)
+		return 0;
+	
+	//Skip slots holding a current value. There are always free ones, as long as CONFIG_STORE_SLOTS > CONFIG_STORE_MAX_KEYS
+	while (slot_is_live(next_slot))
+		next_slot = (next_slot + 1) % CONFIG_STORE_SLOTS;
+	
+	uint8_t record[CONFIG_RECORD_LENGTH];
+	record[0] = CONFIG_STORE_VERSION;
+	record[1] = key;
+	telemetry_put_u32(&record[2], ++last_sequence);
+	telemetry_put_u32(&record[6], value);
+	telemetry_put_u32(&record[10], 0xFFFFFFFF);
+	telemetry_put_u16(&record[CONFIG_RECORD_LENGTH - 2], crc16_ccitt_update(0xFFFF, record, CONFIG_RECORD_LENGTH - 2));
+	eecache_write_buffer(CONFIG_STORE_START + next_slot * CONFIG_RECORD_LENGTH, record, CONFIG_RECORD_LENGTH);
+	eecache_flush();
+	
+	live_slot[key] = next_slot;
+	values[key] = value;
+	next_slot = (next_slot + 1) % CONFIG_STORE_SLOTS;
+	return 0;
+}
@@ -0,0 +1,32 @@
+/*
+ * ConfigStore.h
+ *
+ * Settings kept in EEPROM, so they can be changed from the ground without reflashing.
+ *
+ * Every change is appended as a new record to a circular log of CONFIG_STORE_SLOTS slots instead of overwriting the old
+ * value in place, which spreads the erase cycles over the whole area. A record is:
+ *	version (1) | key (1) | sequence (4) | value (4) | reserved, 0xFF (4) | CRC-16 (2)
+ * little endian, with the CRC (CRC-16/CCITT-FALSE) over everything before it. Records are 16 bytes and 16 byte aligned,
+ * so one never straddles two EEPROM pages and each goes down in a single page write.
+ * The newest valid record of each key (highest sequence) is its value. The slot holding a key's current value is never
+ * written over, so if power drops mid-write only the new record is lost (its CRC fails) and the old value stays.
+ *
+ * config_store_init reads every slot once, so boot takes the same time however many changes have been made.
+ */
+
+
+#ifndef CONFIGSTORE_H_
+#define CONFIGSTORE_H_
+
+#include <asf.h>
+#include "config/conf_config_store.h"
+
+#define CONFIG_STORE_VERSION		1 //Records with another version are ignored
+#define CONFIG_RECORD_LENGTH		16
+#define CONFIG_STORE_MAX_KEYS		16 //Keys are 0 to CONFIG_STORE_MAX_KEYS - 1
+
+void config_store_init(void);
+uint8_t config_store_get(uint8_t key, uint32_t* value);
+uint8_t config_store_set(uint8_t key, uint32_t value);
+
+#endif /* CONFIGSTORE_H_ */
@@ -0,0 +1,119 @@
+/*
+ * EEPROMCache.c
+ *
+ * Page-batched EEPROM writes. See EEPROMCache.h
+ */
+
+#include "drivers/EEPROMCache.h"
+#include <string.h>
+
+#define NO_PAGE		0xFFFF
+
+static uint16_t open_page = NO_PAGE; //EEPROM page the NVM page buffer is collecting writes for
+static uint8_t pending[EEPROM_PAGE_SIZE]; //Copy of what's been loaded into the page buffer, for reads
+static uint32_t pending_mask = 0; //Bit n set = byte n of open_page has been loaded
+static uint8_t pending_count = 0;
+static EEPROMCacheStats_t cache_stats;
+
+#if EEPROM_PAGE_SIZE > 32
+#error "pending_mask only covers 32 byte pages"
+#endif
+
+
+void eecache_flush(void)
+//Erases and writes the open page if anything is waiting in the page buffer
+{
+	if (open_page == NO_PAGE)
+		return;
+	if (pending_mask)
+	{
+		nvm_eeprom_atomic_write_page(open_page); //Only the loaded bytes are touched, the rest of the page keeps its contents
+		cache_stats.page_writes++;
+		cache_stats.bytes_committed += pending_count;
+	}
+	open_page = NO_PAGE;
+	pending_mask = 0;
+	pending_count = 0;
+}
+
+uint8_t eecache_read(eeprom_addr_t address)
+{
+	uint8_t offset = address % EEPROM_PAGE_SIZE;
+	if (address / EEPROM_PAGE_SIZE == open_page && (pending_mask & ((uint32_t)1 << offset)))
+		return pending[offset];
+	return nvm_eeprom_read_byte(address);
+}
+
+void eecache_read_buffer(eeprom_addr_t address, void* dest, uint16_t length)
+{
+	uint8_t* bytes = dest;
+	while (length--)
+		*bytes++ = eecache_read(address++);
+}
+
+void eecache_write(eeprom_addr_t address, uint8_t value)
+//Queues a byte for writing. Blocks only when it has to write out a different page first
+{
+	uint16_t page = address / EEPROM_PAGE_SIZE;
+	uint8_t offset = address % EEPROM_PAGE_SIZE;
+	uint32_t bit = (uint32_t)1 << offset;
+	
+	cache_stats.bytes_requested++;
+	if (eecache_read(address) == value)
+	{
+		cache_stats.bytes_unchanged++;
+		return;
+	}
+	
+	if (page != open_page)
+	{
+		eecache_flush();
+		nvm_eeprom_flush_buffer();
+		open_page = page;
+	}
+	else if (pending_mask & bit)
+	{
+		//Loading a location twice ANDs the values together, so start the page buffer over with everything but this byte
+		nvm_eeprom_flush_buffer();
+		for (uint8_t i = 0; i < EEPROM_PAGE_SIZE; i++)
+		{
+			if (i != offset && (pending_mask & ((uint32_t)1 << i)))
+				nvm_eeprom_load_byte_to_buffer(i, pending[i]);
+		}
+		pending_mask &= ~bit;
+		pending_count--;
+	}
+	
+	nvm_eeprom_load_byte_to_buffer(offset, value);
+	pending[offset] = value;
+	pending_mask |= bit;
+	pending_count++;
+}
+
+void eecache_write_buffer(eeprom_addr_t address, const void* src, uint16_t length)
+//Any length and alignment. Costs one page write per page touched (at the next page change or flush), not per byte
+{
+	const uint8_t* bytes = src;
+	while (length--)
+		eecache_write(address++, *bytes++);
+}
+
+void eecache_get_stats(EEPROMCacheStats_t* stats)
+{
+	*stats = cache_stats;
+}
+
+uint16_t eecache_amplification_percent(void)
+/*	Page erase/write cycles per requested byte, as a percentage
+	100 = no better than nvm_eeprom_write_byte(). A 32 byte record written in one go comes out around 3
+*/
+{
+	if (cache_stats.bytes_requested == 0)
+		return 0;
+	return (uint16_t)((cache_stats.page_writes * 100 + cache_stats.bytes_requested / 2) / cache_stats.bytes_requested);
+}
+
+void eecache_reset_stats(void)
+{
+	memset(&cache_stats, 0, sizeof(cache_stats));
+}
@@ -0,0 +1,37 @@
+/*
+ * EEPROMCache.h
+ *
+ * Write-combining EEPROM access. nvm_eeprom_write_byte() erases and writes a whole page for every byte, which takes
+ * about 4 ms and uses up one of the page's ~100k erase cycles each time. Here writes are collected in the NVM
+ * controller's EEPROM page buffer and the page is only erased and written once, when a write to a different page
+ * comes along or eecache_flush is called. Writes that don't change anything never reach the buffer at all.
+ *
+ * There is only one EEPROM page buffer, so don't mix these functions with ASF's nvm_eeprom_write_* / erase_* functions
+ * while a page is pending (call eecache_flush first). Reads through eecache_read see pending writes.
+ * Nothing pending survives a reset: call eecache_flush before anything that must be on the EEPROM.
+ */
+
+
+#ifndef EEPROMCACHE_H_
+#define EEPROMCACHE_H_
+
+#include <asf.h>
+
+typedef struct EEPROMCacheStats
+{
+	uint32_t bytes_requested; //Every byte passed to eecache_write / eecache_write_buffer
+	uint32_t bytes_unchanged; //Requested bytes that already held the value, so were dropped
+	uint32_t bytes_committed; //Bytes actually programmed
+	uint32_t page_writes; //Erase/write cycles. Writing byte by byte would have cost bytes_requested of these
+} EEPROMCacheStats_t;
+
+void eecache_write(eeprom_addr_t address, uint8_t value);
+void eecache_write_buffer(eeprom_addr_t address, const void* src, uint16_t length);
+uint8_t eecache_read(eeprom_addr_t address);
+void eecache_read_buffer(eeprom_addr_t address, void* dest, uint16_t length);
+void eecache_flush(void);
+void eecache_get_stats(EEPROMCacheStats_t* stats);
+uint16_t eecache_amplification_percent(void);
+void eecache_reset_stats(void);
+
+#endif /* EEPROMCACHE_H_ */
@@ -0,0 +1,236 @@
+/*
+ * FlashLog.c
+ *
+ * Journaled sample log in application flash. See FlashLog.h
+ */
+
+#include "drivers/FlashLog.h"
+#include <string.h>
+
+#if (FLASHLOG_RECORD_LENGTH % 2) != 0 || (FLASHLOG_HEADER_LENGTH % 2) != 0 || (FLASHLOG_FOOTER_LENGTH % 2) != 0
+#error "FlashLog fields must be a whole number of words"
+#endif
+
+static flash_addr_t current_page = FLASHLOG_START; //Page being filled in the page buffer
+static uint8_t page_records = 0; //Records in the page buffer so far
+static uint16_t page_crc; //Over everything loaded into the page buffer so far, which can't be read back
+static uint32_t next_sequence = 0;
+
+static flash_addr_t page_address(uint16_t page);
+static void load_words(flash_addr_t address, const uint8_t* data, uint8_t length);
+static uint16_t page_crc_in_flash(flash_addr_t address);
+static uint8_t page_committed(uint16_t page, uint16_t* count, uint32_t* last_sequence);
+static void flashlog_write_page(void);
+
+
+static flash_addr_t page_address(uint16_t page)
+{
+	return FLASHLOG_START + (flash_addr_t)page * FLASH_PAGE_SIZE;
+}
+
+static void load_words(flash_addr_t address, const uint8_t* data, uint8_t length)
+{
+	for (uint8_t i = 0; i < length; i += 2)
+		nvm_flash_load_word_to_buffer(address + i, data[i] | ((uint16_t)data[i + 1] << 8));
+}
+
+static uint16_t page_crc_in_flash(flash_addr_t address)
+//CRC-16 of a page up to its footer's own CRC
+{
+	uint8_t chunk[32];
+	uint16_t remaining = FLASH_PAGE_SIZE - 2;
+	uint16_t crc = 0xFFFF;
+	while (remaining)
+	{
+		uint8_t length = (remaining < sizeof(chunk)) ? remaining : sizeof(chunk);
+		nvm_flash_read_buffer(address, chunk, length);
+		crc = crc16_ccitt_update(crc, chunk, length);
+		address += length;
+		remaining -= length;
+	}
+	return crc;
+}
+
+static uint8_t page_committed(uint16_t page, uint16_t* count, uint32_t* last_sequence)
+/*	Checks a page's header and footer agree with each other and the page CRC matches, which can only happen once its
+	write has finished. Returns 1 and fills in count and last_sequence if so
+*/
+{
+	uint8_t header[FLASHLOG_HEADER_LENGTH];
+	uint8_t footer[FLASHLOG_FOOTER_LENGTH];
+	flash_addr_t address = page_address(page);
+	nvm_flash_read_buffer(address, header, FLASHLOG_HEADER_LENGTH);
+	nvm_flash_read_buffer(address + FLASH_PAGE_SIZE - FLASHLOG_FOOTER_LENGTH, footer, FLASHLOG_FOOTER_LENGTH);
+	
+	*count = telemetry_get_u16(&footer[0]);
+	*last_sequence = telemetry_get_u32(&footer[2]);
+	if (telemetry_get_u16(&header[0]) != FLASHLOG_PAGE_MAGIC || header[6] != FLASHLOG_VERSION
+			|| *count == 0 || *count > FLASHLOG_RECORDS_PER_PAGE
+			|| *last_sequence != telemetry_get_u32(&header[2]) + *count - 1)
+		return 0;
+	return page_crc_in_flash(address) == telemetry_get_u16(&footer[6]); //Last, it reads the whole page
+}
+
+void flashlog_init(void)
+/*	Finds where the log ends, so new records go after it, by binary search for the first page that isn't committed
+	A page that was being filled when power went is treated as empty and gets erased and reused
+*/
+{
+	uint16_t low = 0, high = FLASHLOG_PAGES; //The first uncommitted page is somewhere in [low, high]
+	uint16_t count;
+	uint32_t last_sequence;
+	
+	while (low < high)
+	{
+		uint16_t middle = low + (high - low) / 2;
+		if (page_committed(middle, &count, &last_sequence))
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	
+	current_page = page_address(low);
+	page_records = 0;
+	next_sequence = (low != 0 && page_committed(low - 1, &count, &last_sequence)) ? last_sequence + 1 : 0;
+}
+
+static void flashlog_write_page(void)
+/*	Adds the footer to the page buffer and programs it into current_page (erased when its first record arrived)
+	Only one write per erase: the XMEGA AU manual only describes programming a page that has been erased since
+*/
+{
+	uint8_t footer[FLASHLOG_FOOTER_LENGTH];
+	const uint8_t erased = 0xFF;
+	
+	//The unused slots stay 0xFF in the page buffer, but still count towards the CRC
+	for (uint16_t i = FLASHLOG_HEADER_LENGTH + page_records * FLASHLOG_RECORD_LENGTH; i < FLASH_PAGE_SIZE - FLASHLOG_FOOTER_LENGTH; i++)
+		page_crc = crc16_ccitt_update(page_crc, &erased, 1);
+	telemetry_put_u16(&footer[0], page_records);
+	telemetry_put_u32(&footer[2], next_sequence - 1);
+	page_crc = crc16_ccitt_update(page_crc, footer, FLASHLOG_FOOTER_LENGTH - 2);
+	telemetry_put_u16(&footer[6], page_crc);
+	load_words(current_page + FLASH_PAGE_SIZE - FLASHLOG_FOOTER_LENGTH, footer, FLASHLOG_FOOTER_LENGTH);
+	
+	nvm_flash_split_write_app_page(current_page);
+	nvm_wait_until_ready();
+	
+	current_page += FLASH_PAGE_SIZE;
+	page_records = 0;
+}
+
+uint8_t flashlog_append(const TelemetrySample_t* sample)
+/*	Adds a sample to the log. It isn't in flash until its page fills up or flashlog_flush is called
+	Return values
+	* 0 - success
+	* 1 - log is full, sample dropped
+*/
+{
+	if (current_page >= FLASHLOG_END)
+		return 1;
+	
+	if (page_records == 0)
+	{
+		//Erase now rather than when the page is written, so the stalls are spread out
+		uint8_t header[FLASHLOG_HEADER_LENGTH];
+		nvm_flash_flush_buffer();
+		nvm_flash_erase_app_page(current_page);
+		telemetry_put_u16(&header[0], FLASHLOG_PAGE_MAGIC);
+		telemetry_put_u32(&header[2], next_sequence);
+		header[6] = FLASHLOG_VERSION;
+		header[7] = 0xFF;
+		load_words(current_page, header, FLASHLOG_HEADER_LENGTH);
+		page_crc = crc16_ccitt_update(0xFFFF, header, FLASHLOG_HEADER_LENGTH);
+	}
+	
+	uint8_t record[FLASHLOG_RECORD_LENGTH];
+	telemetry_put_u32(&record[0], next_sequence);
+	telemetry_put_sample(&record[4], sample);
+	record[FLASHLOG_RECORD_LENGTH - 3] = 0xFF;
+	telemetry_put_u16(&record[FLASHLOG_RECORD_LENGTH - 2], crc16_ccitt_update(0xFFFF, record, FLASHLOG_RECORD_LENGTH - 2));
+	load_words(current_page + FLASHLOG_HEADER_LENGTH + page_records * FLASHLOG_RECORD_LENGTH, record, FLASHLOG_RECORD_LENGTH);
+	page_crc = crc16_ccitt_update(page_crc, record, FLASHLOG_RECORD_LENGTH);
+	next_sequence++;
+	
+	if (++page_records == FLASHLOG_RECORDS_PER_PAGE)
+		flashlog_write_page();
+	return 0;
+}
+
+void flashlog_flush(void)
+//Writes a partly filled page out now. Its unused slots are lost; the next record starts a new page
+{
+	if (page_records != 0)
+		flashlog_write_page();
+}
+
+void flashlog_erase(void)
+//Throws the whole log away. Blocks for a few milliseconds per page used
+{
+	uint16_t used = (current_page - FLASHLOG_START) / FLASH_PAGE_SIZE;
+	
+	//The page being filled, or one left half written by a power cut, may be in the way too
+	if (used < FLASHLOG_PAGES)
+		used++;
+	
+	//Last page first, so if this is interrupted the pages left are still the first N and flashlog_init can find the end
+	while (used--)
+		nvm_flash_erase_app_page(page_address(used));
+	nvm_wait_until_ready();
+	
+	current_page = FLASHLOG_START;
+	page_records = 0;
+	next_sequence = 0;
+}
+
+uint32_t flashlog_end(void)
+//Slot position just past the last committed record, for reading the log
+{
+	return ((current_page - FLASHLOG_START) / FLASH_PAGE_SIZE) * FLASHLOG_RECORDS_PER_PAGE;
+}
+
+uint32_t flashlog_next_sequence(void)
+//Sequence number the next record will get. Carries on across resets
+{
+	return next_sequence;
+}
+
+uint8_t flashlog_read(uint32_t* position, uint8_t* dest, uint8_t max_records)
+/*	Copies up to max_records samples (TELEMETRY_SAMPLE_PAYLOAD_LENGTH bytes each) from the log into dest,
+	starting at slot *position, which is moved past them and any unused or damaged slots in the way. Start from 0
+	Returns the number of samples copied. 0 = reached the end of the log
+*/
+{
+	uint8_t count = 0;
+	uint8_t record[FLASHLOG_RECORD_LENGTH];
+	uint32_t end = flashlog_end();
+	uint16_t checked_page = FLASHLOG_PAGES; //The page CRC reads the whole page, so only once per page per call
+	uint16_t records = 0;
+	uint32_t last_sequence;
+	
+	while (count < max_records && *position < end)
+	{
+		uint16_t page = *position / FLASHLOG_RECORDS_PER_PAGE;
+		uint16_t slot = *position % FLASHLOG_RECORDS_PER_PAGE;
+		
+		if (page != checked_page)
+		{
+			checked_page = page;
+			if (!page_committed(page, &records, &last_sequence))
+				records = 0;
+		}
+		if (slot >= records)
+		{
+			*position = (uint32_t)(page + 1) * FLASHLOG_RECORDS_PER_PAGE; //Nothing more in this page
+			continue;
+		}
+		(*position)++;
+		
+		nvm_flash_read_buffer(page_address(page) + FLASHLOG_HEADER_LENGTH + slot * FLASHLOG_RECORD_LENGTH, record, FLASHLOG_RECORD_LENGTH);
+		if (crc16_ccitt_update(0xFFFF, record, FLASHLOG_RECORD_LENGTH - 2) != telemetry_get_u16(&record[FLASHLOG_RECORD_LENGTH - 2]))
+			continue;
+		memcpy(dest, &record[4], TELEMETRY_SAMPLE_PAYLOAD_LENGTH);
+		dest += TELEMETRY_SAMPLE_PAYLOAD_LENGTH;
+		count++;
+	}
+	return count;
+}
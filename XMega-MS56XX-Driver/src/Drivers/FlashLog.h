@@ -0,0 +1,50 @@
+/*
+ * FlashLog.h
+ *
+ * Keeps every sample in spare application flash, so data that doesn't make it over the radio can be read out after the flight.
+ *
+ * Records are appended to the NVM controller's flash page buffer as they arrive, and the page is only written to flash once
+ * it's full (or flashlog_flush is called), so flash sees one erase and one write per FLASHLOG_RECORDS_PER_PAGE samples.
+ *
+ * The log is a journal, so a power cut at any point loses at most the page being filled:
+ *	page:	header | records ... | unused | footer
+ *	header:	magic (2) | sequence of the first record (4) | version (1) | 0xFF (1)
+ *	record:	sequence (4) | sample in the TELEMETRY_TYPE_SAMPLE layout (13) | 0xFF (1) | CRC-16 (2)
+ *	footer:	record count (2) | sequence of the last record (4) | CRC-16 of the whole page before it (2)
+ * little endian, CRCs are CRC-16/CCITT-FALSE, unused slots are 0xFF. Each page is programmed exactly once after its erase,
+ * header, records and footer together, and only counts once the page CRC checks out, which a write cut off part way
+ * through won't leave behind. Pages are filled in order from FLASHLOG_START and erased from the end back, so the
+ * committed pages are always the first N, and flashlog_init finds the end of the log with a binary search over them
+ * instead of reading the whole area.
+ *
+ * The flash page buffer is shared by the whole chip: nothing else may write application flash while a page is being filled.
+ * The CPU stalls for a few milliseconds whenever a page is erased or written, since the code runs from the same section.
+ * When the log reaches FLASHLOG_END it stops, keeping the oldest data, until flashlog_erase is called.
+ */
+
+
+#ifndef FLASHLOG_H_
+#define FLASHLOG_H_
+
+#include <asf.h>
+#include "config/conf_flashlog.h"
+#include "tools/Telemetry.h"
+
+#define FLASHLOG_VERSION			2 //Version 1 wrote the footer in a second pass over the page
+#define FLASHLOG_PAGE_MAGIC			0x4C4A //"JL"
+#define FLASHLOG_HEADER_LENGTH		8
+#define FLASHLOG_FOOTER_LENGTH		8
+#define FLASHLOG_RECORD_LENGTH		20 //Must be even, the page buffer is loaded a word at a time
+#define FLASHLOG_RECORDS_PER_PAGE	((FLASH_PAGE_SIZE - FLASHLOG_HEADER_LENGTH - FLASHLOG_FOOTER_LENGTH) / FLASHLOG_RECORD_LENGTH)
+#define FLASHLOG_PAGES				((FLASHLOG_END - FLASHLOG_START) / FLASH_PAGE_SIZE)
+#define FLASHLOG_SLOTS				(FLASHLOG_PAGES * FLASHLOG_RECORDS_PER_PAGE)
+
+void flashlog_init(void);
+uint8_t flashlog_append(const TelemetrySample_t* sample);
+void flashlog_flush(void);
+void flashlog_erase(void);
+uint32_t flashlog_end(void);
+uint32_t flashlog_next_sequence(void);
+uint8_t flashlog_read(uint32_t* position, uint8_t* dest, uint8_t max_records);
+
+#endif /* FLASHLOG_H_ */
@@ -42,10 +42,11 @@
 #include "MS56XX.h"
 #include <inttypes.h>
 #include <asf.h>
+#include "drivers/Timebase.h"
+#include "drivers/Profiler.h"
 
 
 void pressureSensorReset(MS56XX_t* sensor);
-uint8_t get_read_info(OSR_Settings osr, uint8_t* D1_read_cmd, uint8_t* D2_read_cmd, uint16_t* delay_time_us);
 uint16_t read16(SPI_t* targetspi);
 uint32_t read24(SPI_t* targetspi);
 
@@ -53,9 +54,11 @@ uint32_t read24(SPI_t* targetspi);
 
 uint16_t read16(SPI_t* targetspi)
 {
-	//Read in 16 bits, MSB first
+	//Read in 16 bits, MSB first. Profiled here rather than in spiread, which the acquisition interrupts use too
+	PROFILE_BEGIN(PROFILE_READ16);
 	uint16_t ret = ((uint16_t)spiread(targetspi)) << 8;
 	ret |= (uint16_t)spiread(targetspi);
+	PROFILE_END(PROFILE_READ16);
 	return ret;
 }
 
@@ -92,55 +95,66 @@ void pressureSensorReset(MS56XX_t* sensor)
 	delay_ms(1);
 }
 
-void calibratePressureSensor(MS56XX_t* sensor)
-//Set up the appropriate SPI before calling this
+uint8_t calibratePressureSensor(MS56XX_t* sensor)
+/*	Set up the appropriate SPI before calling this
+	Reads the whole PROM and only takes C1 - C6 from it if its CRC-4 matches and it isn't all 0s or 1s,
+	which is what a missing sensor (or the wrong select pin) reads back as
+	Return values
+	* 0 - calibrated
+	* 1 - PROM didn't check out, sensor->calibration unchanged
+*/
 {
 	pressureSensorReset(sensor);
 	
-	//Get all the lovely little calibration constants
-	spiselect(sensor->select_pin);
-	spiwrite(sensor->spi, 0b10100010); //Bits 1 - 3 are 001, for C1
-	sensor->SENSt1 = read16(sensor->spi);
-	spideselect(sensor->select_pin);
-
-	spiselect(sensor->select_pin);
-	spiwrite(sensor->spi, 0b10100100); //010 = 2, for C2
-	sensor->OFFt1 = read16(sensor->spi);
-	spideselect(sensor->select_pin);
+	//Get all the lovely little calibration constants. PROM read command is 1010 then the address in bits 1 - 3
+	uint16_t prom[MS56XX_PROM_WORDS];
+	uint16_t all_or = 0x0000;
+	uint16_t all_and = 0xFFFF;
+	for (uint8_t address = 0; address < MS56XX_PROM_WORDS; address++)
+	{
+		spiselect(sensor->select_pin);
+		spiwrite(sensor->spi, 0b10100000 | (address << 1));
+		prom[address] = read16(sensor->spi);
+		spideselect(sensor->select_pin);
+		all_or |= prom[address];
+		all_and &= prom[address];
+	}
+	
+	if (all_or == 0x0000 || all_and == 0xFFFF || MS56XX_prom_crc4(prom) != (prom[7] & 0x000F))
+		return 1;
+	
+	sensor->calibration.SENSt1 = prom[1];
+	sensor->calibration.OFFt1 = prom[2];
+	sensor->calibration.TCS = prom[3];
+	sensor->calibration.TCO = prom[4];
+	sensor->calibration.Tref = prom[5];
+	sensor->calibration.TEMPSENS = prom[6];
+	return 0;
+}
 
-	spiselect(sensor->select_pin);
-	spiwrite(sensor->spi, 0b10100110); // 011 = 3, for C3
-	sensor->TCS = read16(sensor->spi);
-	spideselect(sensor->select_pin);
-
-	spiselect(sensor->select_pin);
-	spiwrite(sensor->spi, 0b10101000); // 100 = 4
-	sensor->TCO = read16(sensor->spi);
-	spideselect(sensor->select_pin);
 
+void MS56XX_command(MS56XX_t* sensor, uint8_t command)
+//Sends a one byte command, e.g. a conversion from get_read_info. A conversion starts when this returns
+{
 	spiselect(sensor->select_pin);
-	spiwrite(sensor->spi, 0b10101010); // 101 = 5
-	sensor->Tref = read16(sensor->spi);
+	spiwrite(sensor->spi, command);
 	spideselect(sensor->select_pin);
+}
 
-
+uint32_t MS56XX_read_adc(MS56XX_t* sensor)
+//Result of the last conversion. 0 if it hadn't finished
+{
 	spiselect(sensor->select_pin);
-	spiwrite(sensor->spi, 0b10101100); // 110 = 6
-	sensor->TEMPSENS = read16(sensor->spi);
+	spiwrite(sensor->spi, 0x0);
+	uint32_t result = read24(sensor->spi);
 	spideselect(sensor->select_pin);
-
-	/*printf("C1\tC2\tC3\tC4\tC5\tC6\t\n");
-	printf("%u\t%u\t%u\t%u\t%u\t%u\n", 
-			sensor->SENSt1, 
-			sensor->OFFt1, 
-			sensor->TCS, 
-			sensor->TCO, 
-			sensor->Tref, 
-			sensor->TEMPSENS);*/
+	return result;
 }
 
-
 void readMS56XX(MS56XX_t* sensor)
+/*	Blocking read of both conversions, sleeping through them. main reads the sensor from drivers/Acquisition.h instead;
+	this is kept for polling use without the acquisition timers, e.g. bringing up a new board. Stop acquisition first
+*/
  {
 	uint32_t rawPressure = 0; //D1
 	uint32_t rawTemp = 0; //D2
@@ -150,6 +164,8 @@ void readMS56XX(MS56XX_t* sensor)
 	
 	uint16_t delay_time;
 	uint8_t D1_cmd, D2_cmd;
+	uint64_t read_start = timebase_ticks();
+	uint64_t slept_start = timebase_slept_ticks();
 	if (get_read_info(sensor->osr, &D1_cmd, &D2_cmd, &delay_time)) //Return flag of 1 = OSR not supported
 	{
 		//Mark data as invalid and exit function
@@ -159,100 +175,33 @@ void readMS56XX(MS56XX_t* sensor)
 	//If get_read_info succeeded, D1_cmd, D2_cmd, and delay_time will now have the appropriate values for the selected OSR
 
 	//Ask for raw pressure, 4096 OSR
-	spiselect(sensor->select_pin);
-	spiwrite(sensor->spi, D1_cmd);
-	spideselect(sensor->select_pin);
+	MS56XX_command(sensor, D1_cmd);
+	
+	//Conversion starts when select goes high. delay_time is the datasheet's maximum conversion time, close enough to the real one
+	uint64_t conversion_start = timebase_ticks();
+	sensor->data.timestamp = (uint32_t)(conversion_start / TIMEBASE_TICKS_PER_US) + delay_time / 2;
 
-	delay_us(delay_time);
+	timebase_sleep_until(conversion_start + (uint32_t)delay_time * TIMEBASE_TICKS_PER_US);
 
 	//Read off raw pressure (D1)
-	spiselect(sensor->select_pin);
-	spiwrite(sensor->spi, 0x0);
-	rawPressure = read24(sensor->spi);
-	spideselect(sensor->select_pin);
+	rawPressure = MS56XX_read_adc(sensor);
 	
 	//Ask for raw temperature, 4096 OSR
-	spiselect(sensor->select_pin);
-	spiwrite(sensor->spi, D2_cmd); //OSR = 4096
-	spideselect(sensor->select_pin);
+	MS56XX_command(sensor, D2_cmd);
 	
-	delay_us(delay_time);
+	timebase_sleep_us(delay_time);
 
 	//Read off raw temperature (D2)
-	spiselect(sensor->select_pin);
-	spiwrite(sensor->spi, 0x0);
-	rawTemp = read24(sensor->spi);
-	spideselect(sensor->select_pin);
-	
-	int32_t dT = rawTemp - (int32_t)(((int64_t)sensor->Tref) << 8);
-	int32_t TEMP = (int32_t)(((int32_t)2000) + ((int32_t)(((int64_t)dT) * ((int64_t)sensor->TEMPSENS) >> 23)));
-	
-	int32_t T2 = 0;
-	int64_t OFF2 = 0;
-	int64_t SENS2 = 0;
-	
-	if (TEMP < 2000)
-	{
-		T2 = ((int64_t)dT) * ((int64_t)dT) / ((int64_t)2147483648);
-		OFF2 = ((int64_t)61) * ((int64_t)(TEMP - 2000)) * ((int64_t)(TEMP - 2000)) >> 4;
-		SENS2 = ((int64_t)2) * ((int64_t)(TEMP - 2000)) * ((int64_t)(TEMP - 2000));
-	}
-	else
-	{
-	    T2 = 0;
-		OFF2 = 0;
-		SENS2 = 0;	
-	} 
-	
-	if (TEMP<-1500)
-	{
-		OFF2 += ((int64_t)15) * (((int64_t) TEMP) + ((int64_t) 1500))^2; 
-		SENS2 += ((int64_t) 8) * (((int64_t) TEMP) + ((int64_t) 1500) )^2;
-	}
-	uint8_t offshift1, offshift2, sens_shift1, sens_shift2;
-	switch (sensor->model)
-	{
-		case MS5607:
-			offshift1 = 17;
-			offshift2 = 6;
-			sens_shift1 = 16;
-			sens_shift2 = 7;
-			break;
-		case MS5611:
-			offshift1 = 17;
-			offshift2 = 6;
-			sens_shift1 = 16;
-			sens_shift2 = 7;
-			break;
-		default:
-			sensor->data.valid = 0;
-			return;
-	}
-	int64_t OFF = (((int64_t)sensor->OFFt1) << offshift1) +
-	((((int64_t)sensor->TCO) * ((int64_t)dT)) >> offshift2);
-	
-	int64_t SENS = (((int64_t)sensor->SENSt1) << sens_shift1) + ((((int64_t)sensor->TCS) * ((int64_t)dT)) >> sens_shift2);
-		
-	TEMP -= T2;
-	OFF -= OFF2;
-	SENS -= SENS2;
+	rawTemp = MS56XX_read_adc(sensor);
 	
-	int64_t PRESSURE = ((((int64_t)rawPressure) * SENS >> 21) - OFF) >> 15;
-			
-	/*printf("C1\tC2\tC3\tC4\tC5\tC6\t\n");
-	printf("%u\t%u\t%u\t%u\t%u\t%u\n",
-	pressureSensorCalibration.SENSt1,
-	pressureSensorCalibration.OFFt1,
-	pressureSensorCalibration.TCS,
-	pressureSensorCalibration.TCO,
-	pressureSensorCalibration.Tref,
-	pressureSensorCalibration.TEMPSENS);*/
-				
-	/*printf("TEMP: %" PRIi32 "\n", TEMP);
-	printf("Pressure: %" PRIi32 "\n", (int32_t)PRESSURE);*/
+	sensor->data.raw_pressure = rawPressure;
+	sensor->data.raw_temperature = rawTemp;
+	if (MS56XX_compensate(&sensor->calibration, sensor->model, rawPressure, rawTemp, &sensor->data.pressure, &sensor->data.temperature))
+		sensor->data.valid = 0;
 	
-	sensor->data.pressure = (int32_t) PRESSURE; //In pascals
-	sensor->data.temperature = TEMP; //In hundredths of degree celsius
+	uint32_t elapsed = (uint32_t)(timebase_ticks() - read_start);
+	uint32_t slept = (uint32_t)(timebase_slept_ticks() - slept_start);
+	sensor->data.active_percent = elapsed ? (uint8_t)(100 - (uint64_t)slept * 100 / elapsed) : 100;
  }
  
  uint8_t get_read_info(OSR_Settings osr, uint8_t* D1_read_cmd, uint8_t* D2_read_cmd, uint16_t* delay_time_us)
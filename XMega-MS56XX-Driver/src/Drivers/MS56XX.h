@@ -8,11 +8,7 @@
 
 #include <asf.h>
 #include "SPI.h"
-
-typedef enum {
-	MS5607 = 1,
-	MS5611 = 2
-} SENSOR_TYPE;
+#include "tools/MS56XXCompensation.h"
 
 typedef enum {
 	OSR_4096,
@@ -27,6 +23,10 @@ typedef struct MS56XX_Data
 	int32_t pressure; //Pascals
 	int32_t temperature; //Centi-degrees celsius
 	uint8_t valid; //1 = sensor believes data to be valid (no guarantee that it actually is), 0 = anomalous (all 0s or 1s) measurements
+	uint32_t raw_pressure; //D1, for recompensating on the ground
+	uint32_t raw_temperature; //D2
+	uint32_t timestamp; //timebase_us() in the middle of the pressure (D1) conversion
+	uint8_t active_percent; //Share of the read the CPU spent on it: awake in readMS56XX, in the interrupts for drivers/Acquisition.h
 } MS56XX_Data_t;
 
 typedef struct MS56XX
@@ -38,18 +38,18 @@ typedef struct MS56XX
 	MS56XX_Data_t data;
 	OSR_Settings osr;
 	
-	//For internal use only
-	uint16_t SENSt1; //C1
-	uint16_t OFFt1; //C2
-	uint16_t TCS; //You can guess
-	uint16_t TCO;
-	uint16_t Tref;
-	uint16_t TEMPSENS;
+	//Read from the sensor's PROM by calibratePressureSensor
+	MS56XX_Calibration_t calibration;
 } MS56XX_t;
 
-void calibratePressureSensor(MS56XX_t* sensor);
+uint8_t calibratePressureSensor(MS56XX_t* sensor);
 void readMS56XX(MS56XX_t* sensor);
 
+//Pieces of readMS56XX, for reading the sensor from interrupts (drivers/Acquisition.h)
+uint8_t get_read_info(OSR_Settings osr, uint8_t* D1_read_cmd, uint8_t* D2_read_cmd, uint16_t* delay_time_us);
+void MS56XX_command(MS56XX_t* sensor, uint8_t command);
+uint32_t MS56XX_read_adc(MS56XX_t* sensor);
+
 MS56XX_t define_new_MS56XX(SENSOR_TYPE model, SPI_t* spi, ioport_pin_t select_pin, OSR_Settings osr);
 MS56XX_t define_new_MS56XX_default_OSR(SENSOR_TYPE model, SPI_t* spi, ioport_pin_t select_pin);
 
@@ -0,0 +1,99 @@
+/*
+ * Profiler.c
+ *
+ * Per-region cycle counts. See Profiler.h
+ */
+
+#include "drivers/Profiler.h"
+
+#ifdef DEBUG
+
+static ProfileStats_t regions[PROFILE_REGIONS];
+static const char* const region_names[PROFILE_REGIONS] = PROFILER_REGION_NAMES;
+static uint32_t overhead = 0; //Cycles an empty PROFILE_BEGIN/PROFILE_END pair reads
+
+void profiler_init(void)
+//Starts the cycle counter and clears the statistics
+{
+	sysclk_enable_peripheral_clock(&PROFILER_LOW_TC);
+	sysclk_enable_peripheral_clock(&PROFILER_HIGH_TC);
+	sysclk_enable_peripheral_clock(&EVSYS);
+	
+	PROFILER_LOW_TC.CTRLA = TC_CLKSEL_OFF_gc;
+	PROFILER_HIGH_TC.CTRLA = TC_CLKSEL_OFF_gc;
+	PROFILER_LOW_TC.PER = 0xFFFF;
+	PROFILER_HIGH_TC.PER = 0xFFFF;
+	PROFILER_LOW_TC.CNT = 0;
+	PROFILER_HIGH_TC.CNT = 0;
+	
+	PROFILER_EVENT_MUX = PROFILER_EVENT_SOURCE;
+	PROFILER_HIGH_TC.CTRLA = PROFILER_EVENT_CLKSEL;
+	PROFILER_LOW_TC.CTRLA = TC_CLKSEL_DIV1_gc;
+	
+	//Smallest of a few tries, in case an interrupt lands in one
+	overhead = UINT32_MAX;
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		uint32_t start = profiler_cycles();
+		uint32_t cycles = profiler_cycles() - start;
+		if (cycles < overhead)
+			overhead = cycles;
+	}
+	profiler_reset();
+}
+
+uint32_t profiler_cycles(void)
+//CPU cycles since profiler_init, wrapping every 134 s. Only differences mean anything
+{
+	uint16_t high, low;
+	
+	//Interrupts off: an ISR reading either timer would clobber its TEMP register between our two byte reads
+	irqflags_t flags = cpu_irq_save();
+	do
+	{
+		high = PROFILER_HIGH_TC.CNT;
+		low = PROFILER_LOW_TC.CNT;
+	} while (high != PROFILER_HIGH_TC.CNT); //Low half wrapped between the reads
+	cpu_irq_restore(flags);
+	
+	return ((uint32_t)high << 16) | low;
+}
+
+void profiler_record(ProfileRegion region, uint32_t start)
+//Adds one run of region, started at profiler_cycles() = start
+{
+	uint32_t cycles = profiler_cycles() - start;
+	cycles = cycles > overhead ? cycles - overhead : 0;
+	
+	ProfileStats_t* stats = &regions[region];
+	if (cycles < stats->min)
+		stats->min = cycles;
+	if (cycles > stats->max)
+		stats->max = cycles;
+	stats->total += cycles;
+	stats->count++;
+}
+
+void profiler_get(ProfileRegion region, ProfileStats_t* stats)
+//Copies region's statistics. min is UINT32_MAX if it hasn't run since the last reset
+{
+	*stats = regions[region];
+}
+
+const char* profiler_region_name(ProfileRegion region)
+{
+	return region_names[region];
+}
+
+void profiler_reset(void)
+{
+	for (uint8_t i = 0; i < PROFILE_REGIONS; i++)
+	{
+		regions[i].count = 0;
+		regions[i].min = UINT32_MAX;
+		regions[i].max = 0;
+		regions[i].total = 0;
+	}
+}
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ * Profiler.h
+ *
+ * Cycle counts for hot pieces of code. Wrap a region in PROFILE_BEGIN(region) and PROFILE_END(region), in the same block,
+ * and the profiler keeps how many times it ran and its shortest, longest and total time in CPU cycles.
+ *
+ * Cycles come from two 16 bit timers cascaded through the event system, so regions up to 134 s are timed exactly.
+ * The cost of the markers themselves is measured by profiler_init and taken off every reading. Nested regions still
+ * count their children's markers.
+ *
+ * Only DEBUG builds have it: everywhere else the markers expand to nothing and none of this is compiled.
+ * The statistics aren't protected from interrupts, and the markers' cost isn't in the latency budget (conf_interrupts.h):
+ * only put them in code that runs at main level, so DEBUG builds have the same interrupt timing as the rest.
+ */
+
+
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <asf.h>
+#include "config/conf_profiler.h"
+
+typedef struct ProfileStats
+{
+	uint32_t count;
+	uint32_t min; //Cycles
+	uint32_t max;
+	uint64_t total;
+} ProfileStats_t;
+
+#ifdef DEBUG
+
+void profiler_init(void);
+uint32_t profiler_cycles(void);
+void profiler_record(ProfileRegion region, uint32_t start);
+void profiler_get(ProfileRegion region, ProfileStats_t* stats);
+const char* profiler_region_name(ProfileRegion region);
+void profiler_reset(void);
+
+#define PROFILE_BEGIN(region)	uint32_t profile_start_##region = profiler_cycles()
+#define PROFILE_END(region)		profiler_record(region, profile_start_##region)
+
+#else
+
+#define profiler_init()
+#define PROFILE_BEGIN(region)
+#define PROFILE_END(region)
+
+#endif
+
+#endif /* PROFILER_H_ */
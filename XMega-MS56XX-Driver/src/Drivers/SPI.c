@@ -15,6 +15,15 @@ uint8_t spiread(SPI_t* targetspi)
 
 }
 
+void spiread_block(SPI_t* targetspi, uint8_t* dest, uint16_t length)
+//Reads length bytes straight into dest, e.g. a region handed out by rbu8_reserve, so no intermediate copy is needed
+{
+	for (uint16_t i = 0; i < length; i++)
+	{
+		dest[i] = spiread(targetspi);
+	}
+}
+
 void spiwrite(SPI_t* targetspi, uint8_t data)
 {
 	targetspi->DATA = data;
@@ -11,6 +11,7 @@
 #include <asf.h>
 
 uint8_t spiread(SPI_t* targetspi);
+void spiread_block(SPI_t* targetspi, uint8_t* dest, uint16_t length);
 void spiwrite(SPI_t* targetspi, uint8_t data);
 void spiselect(ioport_pin_t pin);
 void spideselect(ioport_pin_t pin);
@@ -0,0 +1,137 @@
+/*
+ * Timebase.c
+ *
+ * 32 bit hardware timer extended to 64 bits. See Timebase.h
+ */
+
+#include "drivers/Timebase.h"
+#include <avr/sleep.h>
+
+#define SLEEP_STEP_TICKS	0xFF00 //Longest single sleep, a little short of the low timer's period so the compare can't be missed
+#define SLEEP_MIN_TICKS		16 //4 us, 128 cycles. Shorter waits spin: setting up the compare, sleeping and the wake interrupt take about that
+
+static volatile uint32_t overflows = 0; //Upper 32 bits of the tick count
+static uint64_t slept_ticks = 0;
+
+ISR(TIMEBASE_HIGH_OVF_vect)
+{
+	overflows++;
+}
+
+ISR(TIMEBASE_LOW_CCA_vect)
+{
+	//Nothing to do, it's only here to wake timebase_sleep_until
+}
+
+void timebase_init(void)
+//Starts counting from 0. Enables TIMEBASE_PMIC_LEVEL interrupts
+{
+	sysclk_enable_peripheral_clock(&TIMEBASE_LOW_TC);
+	sysclk_enable_peripheral_clock(&TIMEBASE_HIGH_TC);
+	sysclk_enable_peripheral_clock(&EVSYS);
+	
+	TIMEBASE_LOW_TC.CTRLA = TC_CLKSEL_OFF_gc;
+	TIMEBASE_HIGH_TC.CTRLA = TC_CLKSEL_OFF_gc;
+	TIMEBASE_LOW_TC.PER = 0xFFFF;
+	TIMEBASE_HIGH_TC.PER = 0xFFFF;
+	TIMEBASE_LOW_TC.CNT = 0;
+	TIMEBASE_HIGH_TC.CNT = 0;
+	overflows = 0;
+	
+	TIMEBASE_EVENT_MUX = TIMEBASE_EVENT_SOURCE;
+	TIMEBASE_HIGH_TC.INTCTRLA = TIMEBASE_OVF_INTLVL;
+	pmic_enable_level(TIMEBASE_PMIC_LEVEL);
+	
+	TIMEBASE_HIGH_TC.CTRLA = TIMEBASE_EVENT_CLKSEL;
+	TIMEBASE_LOW_TC.CTRLA = TIMEBASE_PRESCALER;
+}
+
+uint64_t timebase_ticks(void)
+//Ticks (TIMEBASE_TICKS_PER_US per microsecond) since timebase_init
+{
+	uint16_t high, low;
+	uint32_t upper;
+	
+	//Interrupts off: an ISR reading either timer would clobber its TEMP register between our two byte reads
+	irqflags_t flags = cpu_irq_save();
+	do
+	{
+		high = TIMEBASE_HIGH_TC.CNT;
+		low = TIMEBASE_LOW_TC.CNT;
+	} while (high != TIMEBASE_HIGH_TC.CNT); //Low half wrapped between the reads
+	upper = overflows;
+	if ((TIMEBASE_HIGH_TC.INTFLAGS & TC1_OVFIF_bm) && high < 0x8000)
+		upper++; //Overflow happened with interrupts off and hasn't been counted yet
+	cpu_irq_restore(flags);
+	
+	return ((uint64_t)upper << 32) | ((uint32_t)high << 16) | low;
+}
+
+uint32_t timebase_us(void)
+//Microseconds since timebase_init, wrapping every 71 minutes
+{
+	return (uint32_t)(timebase_ticks() / TIMEBASE_TICKS_PER_US);
+}
+
+uint32_t timebase_ms(void)
+//Milliseconds since timebase_init
+{
+	return (uint32_t)(timebase_ticks() / (TIMEBASE_TICKS_PER_US * 1000UL));
+}
+
+void timebase_sleep_until(uint64_t deadline)
+/*	Idles until timebase_ticks() reaches deadline. Returns straight away if it already has
+	Sleeping needs interrupts, so they're enabled while asleep, and put back as they were on the way out
+	The last SLEEP_MIN_TICKS are spun, as the wake up would take longer than that
+*/
+{
+	irqflags_t flags = cpu_irq_save();
+	set_sleep_mode(SLEEP_SMODE_IDLE_gc);
+	sleep_enable();
+	while (1)
+	{
+		//Checked with interrupts off, so a compare match can't land between the check and the sleep
+		uint64_t now = timebase_ticks();
+		if (now >= deadline)
+			break;
+		uint64_t remaining = deadline - now;
+		if (remaining < SLEEP_MIN_TICKS)
+			break;
+		uint16_t step = remaining > SLEEP_STEP_TICKS ? SLEEP_STEP_TICKS : remaining;
+		
+		//Flag cleared first, so a match straight after the new compare goes in isn't thrown away
+		TIMEBASE_LOW_TC.INTFLAGS = TC0_CCAIF_bm;
+		TIMEBASE_LOW_TC.CCA = (uint16_t)now + step;
+		TIMEBASE_LOW_TC.INTCTRLB = TIMEBASE_WAKE_INTLVL;
+		
+		//The counter kept going while that was set up. Already past the compare with no match means nothing would wake us
+		if (!(TIMEBASE_LOW_TC.INTFLAGS & TC0_CCAIF_bm) && (uint16_t)(TIMEBASE_LOW_TC.CNT - (uint16_t)now) >= step)
+			continue;
+		
+		//The instruction after sei always runs before any interrupt, so this can't miss its wake up
+		__asm__ __volatile__ ("sei" "\n\t" "sleep" ::: "memory");
+		cpu_irq_disable();
+		slept_ticks += timebase_ticks() - now;
+	}
+	TIMEBASE_LOW_TC.INTCTRLB = TC_CCAINTLVL_OFF_gc;
+	sleep_disable();
+	cpu_irq_restore(flags);
+	
+	while (timebase_ticks() < deadline)
+		; //Whatever was too short to sleep through
+}
+
+void timebase_sleep_us(uint32_t us)
+//Drop-in for delay_us that sleeps instead of spinning
+{
+	timebase_sleep_until(timebase_ticks() + (uint64_t)us * TIMEBASE_TICKS_PER_US);
+}
+
+uint64_t timebase_slept_ticks(void)
+//Total ticks spent asleep in timebase_sleep_until. Includes any interrupts that ran while asleep
+{
+	irqflags_t flags = cpu_irq_save();
+	uint64_t slept = slept_ticks;
+	cpu_irq_restore(flags);
+	return slept;
+}
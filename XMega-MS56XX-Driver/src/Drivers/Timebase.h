@@ -0,0 +1,33 @@
+/*
+ * Timebase.h
+ *
+ * Free-running time since timebase_init, for timestamping samples and measuring rates and latency.
+ *
+ * Two 16 bit timers are cascaded through the event system into a 32 bit counter at TIMEBASE_TICKS_PER_US per microsecond,
+ * which wraps every 18 minutes; an overflow interrupt (TIMEBASE_OVF_INTLVL) extends that to 64 bits in software.
+ * timebase_us wraps every 71 minutes, so take differences of it rather than comparing; timebase_ms lasts 49 days.
+ * All three can be called from interrupts.
+ *
+ * timebase_sleep_until waits in idle sleep instead of spinning like delay_us: compare channel A of TIMEBASE_LOW_TC wakes
+ * the core at the deadline (and every 16 ms on the way there for longer waits). Other interrupts still run while it waits.
+ * The last few microseconds are spun, since waking up takes about as long.
+ * The time spent asleep is totalled, so callers can work out how busy the CPU really was.
+ */
+
+
+#ifndef TIMEBASE_H_
+#define TIMEBASE_H_
+
+#include <asf.h>
+#include "config/conf_timebase.h"
+#include "config/conf_interrupts.h"
+
+void timebase_init(void);
+uint64_t timebase_ticks(void);
+uint32_t timebase_us(void);
+uint32_t timebase_ms(void);
+void timebase_sleep_until(uint64_t deadline);
+void timebase_sleep_us(uint32_t us);
+uint64_t timebase_slept_ticks(void);
+
+#endif /* TIMEBASE_H_ */
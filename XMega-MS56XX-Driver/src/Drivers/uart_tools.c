@@ -7,7 +7,33 @@
 
 #include <asf.h>
 #include "config/conf_usart_serial.h"
+#include "config/conf_interrupts.h"
 #include "drivers/uart_tools.h"
+#include "tools/RingBuffer.h"
+
+#if USART_SERIAL_TX_BUFFER_SIZE > RBSPSC_MAX_ARRAY_LENGTH || USART_SERIAL_RX_BUFFER_SIZE > RBSPSC_MAX_ARRAY_LENGTH
+#error "The UART buffers are RingBufferSPSC_t, which can't be longer than RBSPSC_MAX_ARRAY_LENGTH"
+#endif
+
+//Main loop writes, DRE or DMA interrupt reads
+static RingBufferSPSC_t tx_buffer;
+static uint8_t tx_backing_array[USART_SERIAL_TX_BUFFER_SIZE];
+static USART_t* tx_usart;
+static bool tx_use_dma;
+static volatile uint16_t tx_dma_length; //Bytes in the span the DMA channel is sending. 0 = idle
+static volatile uint32_t tx_dropped; //Queued bytes the DMA channel failed to send. Only written by the interrupt
+
+//RXC interrupt writes, main loop reads
+static RingBufferSPSC_t rx_buffer;
+static uint8_t rx_backing_array[USART_SERIAL_RX_BUFFER_SIZE];
+static USART_t* rx_usart;
+static volatile uint32_t rx_overruns; //Bytes dropped because rx_buffer was full. Only written by the interrupt
+
+static UART_baud_t current_baud;
+
+static void uart_tx_start(void);
+static void uart_tx_dma_start(void);
+static void uart_tx_dma_complete(void);
 
 void UART_computer_init(USART_t* comms_usart, PORT_t* comms_port, ioport_pin_t tx_pin, ioport_pin_t rx_pin)
 /* This sets up the UART pins that are used by the XBee (if plugged into a one month board), and by the computer during debugging
@@ -26,4 +52,318 @@ Based on Adam's code template for one month, but with RX pin configuration. */
 	sysclk_enable_peripheral_clock(comms_usart); 
 	
 	stdio_serial_init(comms_usart, &options);
-}
\ No newline at end of file
+	UART_set_baudrate(comms_usart, USART_SERIAL_BAUDRATE); //ASF only tries one CLK2X setting, this looks for the closest match
+}
+
+//-------------Baud rate selection-------------
+
+bool UART_find_baud(uint32_t baud, uint32_t per_hz, UART_baud_t* setting)
+/* Tries every BSCALE (-7 to 7) with CLK2X off and on, and keeps whichever BSEL gives the baud rate closest to baud.
+	BSCALE >= 0: actual = per_hz / (2^BSCALE * S * (BSEL + 1))
+	BSCALE < 0:  actual = per_hz / (S * (2^BSCALE * BSEL + 1))
+	S is 16 normally and 8 with CLK2X. Ties go to CLK2X off, since 16 samples per bit tolerate more noise.
+Doesn't touch the hardware. Returns false if no setting exists at all, otherwise check setting->error_ppm. */
+{
+	bool found = false;
+	uint32_t best_error = 0xFFFFFFFF;
+	
+	for (uint8_t clk2x = 0; clk2x < 2; clk2x++)
+	{
+		uint64_t samples_baud = (uint64_t)(clk2x ? 8 : 16) * baud;
+		for (int8_t bscale = -7; bscale <= 7; bscale++)
+		{
+			uint64_t bsel, actual;
+			if (bscale >= 0)
+			{
+				uint64_t denominator = samples_baud << bscale;
+				bsel = (per_hz + denominator / 2) / denominator;
+				if (bsel == 0)
+					continue;
+				bsel--;
+				actual = per_hz / ((bsel + 1) * (samples_baud / baud) << bscale);
+			}
+			else
+			{
+				//Fractional BSEL. Only used while the whole part is at least 1, so the fractional part can't dominate
+				uint64_t fraction = ((uint64_t)1) << -bscale;
+				if (per_hz < 2 * samples_baud)
+					continue;
+				bsel = ((((uint64_t)per_hz - samples_baud) << -bscale) + samples_baud / 2) / samples_baud;
+				actual = (((uint64_t)per_hz) << -bscale) / ((samples_baud / baud) * (bsel + fraction));
+			}
+			if (bsel > 0xFFF)
+				continue;
+			
+			uint32_t error = (actual > baud) ? actual - baud : baud - actual;
+			if (error < best_error)
+			{
+				best_error = error;
+				found = true;
+				setting->actual = actual;
+				setting->bsel = bsel;
+				setting->bscale = bscale;
+				setting->clk2x = clk2x;
+			}
+		}
+	}
+	
+	setting->requested = baud;
+	if (found)
+		setting->error_ppm = (int32_t)((((int64_t)setting->actual - baud) * 1000000) / baud);
+	return found;
+}
+
+bool UART_set_baudrate(USART_t* comms_usart, uint32_t baud)
+/* Switches comms_usart to the closest baud rate UART_find_baud can get, using the peripheral clock.
+Refuses (returns false, nothing changed) if the error would be over USART_SERIAL_MAX_BAUD_ERROR_PPM.
+Anything still being sent goes out at the new rate, so UART_tx_flush first if that matters. */
+{
+	UART_baud_t setting;
+	if (!UART_find_baud(baud, sysclk_get_per_hz(), &setting))
+		return false;
+	if (setting.error_ppm > USART_SERIAL_MAX_BAUD_ERROR_PPM || setting.error_ppm < -USART_SERIAL_MAX_BAUD_ERROR_PPM)
+		return false;
+	
+	if (setting.clk2x)
+		comms_usart->CTRLB |= USART_CLK2X_bm;
+	else
+		comms_usart->CTRLB &= ~USART_CLK2X_bm;
+	usart_set_bsel_bscale_value(comms_usart, setting.bsel, (uint8_t)setting.bscale);
+	
+	current_baud = setting;
+	return true;
+}
+
+void UART_get_baud(UART_baud_t* setting)
+//Copies out what the last successful UART_set_baudrate picked, including the actual rate and its error
+{
+	*setting = current_baud;
+}
+
+void UART_tx_interrupt_init(USART_t* comms_usart, bool redirect_stdio)
+/* Call after UART_computer_init. From then on, UART_write queues data and returns right away,
+and the Data Register Empty interrupt sends it in the background at low interrupt level.
+comms_usart has to be the USART that USART_SERIAL_DRE_vect in conf_usart_serial.h belongs to.
+If redirect_stdio is set, printf goes through the queue too instead of waiting on every character.
+Enables interrupts. */
+{
+	rbspsc_init(&tx_buffer, tx_backing_array, USART_SERIAL_TX_BUFFER_SIZE);
+	tx_usart = comms_usart;
+	tx_use_dma = false;
+	
+	if (redirect_stdio)
+	{
+		ptr_put = UART_putchar_buffered;
+	}
+	
+	pmic_enable_level(USART_SERIAL_TX_PMIC_LEVEL);
+	cpu_irq_enable();
+}
+
+uint16_t UART_write(const uint8_t* data, uint16_t length)
+/* Queues up to length bytes for sending and returns how many were queued. Never waits.
+Anything that doesn't fit in the buffer is not sent, so check the return value or UART_tx_free_space. */
+{
+	length = rbspsc_write(&tx_buffer, data, length);
+	if (length)
+	{
+		uart_tx_start();
+	}
+	return length;
+}
+
+uint16_t UART_tx_free_space(void)
+{
+	return rbspsc_free_space(&tx_buffer);
+}
+
+void UART_tx_flush(void)
+//Waits until everything queued has been handed to the USART
+{
+	while (rbspsc_free_space(&tx_buffer) != USART_SERIAL_TX_BUFFER_SIZE - 1);
+}
+
+int UART_putchar_buffered(volatile void* usart, char c)
+/* Same signature as the ptr_put hook used by stdio_serial, so printf can use it.
+printf has no way to retry, so this waits for room instead of dropping the character.
+If interrupts are off nothing would ever make room, so it does the interrupt's job itself. */
+{
+	uint8_t oldest;
+	while (rbspsc_put(&tx_buffer, c))
+	{
+		if (cpu_irq_is_enabled())
+			continue;
+		if (!tx_use_dma && !rbspsc_get(&tx_buffer, &oldest))
+		{
+			usart_putchar(tx_usart, oldest);
+		}
+		else if (tx_use_dma && (USART_SERIAL_DMA_CHANNEL.CTRLB & (DMA_CH_TRNIF_bm | DMA_CH_ERRIF_bm)))
+		{
+			uart_tx_dma_complete(); //Would have been the interrupt's job. An error ends the span too
+		}
+		else if (tx_use_dma)
+		{
+			uart_tx_dma_start();
+		}
+	}
+	uart_tx_start();
+	return 0;
+}
+
+ISR(USART_SERIAL_DRE_vect)
+{
+	uint8_t data;
+	if (rbspsc_get(&tx_buffer, &data))
+	{
+		//Nothing left to send. Turn the interrupt off until UART_write queues more
+		usart_set_dre_interrupt_level(tx_usart, USART_INT_LVL_OFF);
+	}
+	else
+	{
+		usart_put(tx_usart, data);
+	}
+}
+
+//-------------Interrupt-driven receive-------------
+
+void UART_rx_interrupt_init(USART_t* comms_usart)
+/* Call after UART_computer_init. Every received byte is moved into a buffer by the Receive Complete interrupt
+(medium level, see conf_interrupts.h), so nothing is lost while the main loop is busy. Read it back with UART_read.
+comms_usart has to be the USART that USART_SERIAL_RXC_vect in conf_usart_serial.h belongs to.
+Enables interrupts. */
+{
+	rbspsc_init(&rx_buffer, rx_backing_array, USART_SERIAL_RX_BUFFER_SIZE);
+	rx_usart = comms_usart;
+	rx_overruns = 0;
+	
+	usart_set_rx_interrupt_level(comms_usart, USART_SERIAL_RXC_INTLVL);
+	pmic_enable_level(USART_SERIAL_RX_PMIC_LEVEL);
+	cpu_irq_enable();
+}
+
+uint16_t UART_read(uint8_t* dest, uint16_t length)
+//Takes up to length received bytes out of the buffer, oldest first. Returns how many there were. Never waits
+{
+	return rbspsc_read(&rx_buffer, dest, length);
+}
+
+uint16_t UART_rx_length(void)
+//Number of received bytes waiting to be read
+{
+	return rbspsc_length(&rx_buffer);
+}
+
+uint32_t UART_rx_overruns(void)
+//Number of received bytes lost, because the main loop didn't read them in time or the interrupt itself was held off too long
+{
+	irqflags_t flags = cpu_irq_save(); //32 bits take four reads, the interrupt could change it in between
+	uint32_t overruns = rx_overruns;
+	cpu_irq_restore(flags);
+	return overruns;
+}
+
+ISR(USART_SERIAL_RXC_vect)
+{
+	if (rx_usart->STATUS & USART_BUFOVF_bm)
+		rx_overruns++; //The USART's own buffer filled before we got here. Only valid until DATA is read
+	
+	//Reading DATA clears the interrupt, so read it even if there's nowhere to put it
+	if (rbspsc_put(&rx_buffer, usart_get(rx_usart)))
+	{
+		rx_overruns++;
+	}
+}
+
+static void uart_tx_start(void)
+//Makes sure whatever is sending in the background knows there is data waiting
+{
+	if (tx_use_dma)
+		uart_tx_dma_start();
+	else
+		usart_set_dre_interrupt_level(tx_usart, USART_SERIAL_DRE_INTLVL);
+}
+
+//-------------DMA transmit-------------
+
+void UART_tx_dma_init(USART_t* comms_usart, bool redirect_stdio)
+/* Same as UART_tx_interrupt_init, but the queue is drained by a DMA channel instead of the DRE interrupt.
+Each contiguous span of the queue is handed to the channel in one go, so the CPU only gets one interrupt per span
+instead of one per byte. The channel moves a byte every time the USART's data register empties.
+USART_SERIAL_DMA_CHANNEL, _TRIGGER and _vect in conf_usart_serial.h have to match comms_usart. */
+{
+	DMA_CH_t* channel = &USART_SERIAL_DMA_CHANNEL;
+	
+	UART_tx_interrupt_init(comms_usart, redirect_stdio);
+	tx_dma_length = 0;
+	
+	sysclk_enable_peripheral_clock(&DMA);
+	DMA.CTRL |= DMA_ENABLE_bm;
+	
+	channel->ADDRCTRL = DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_INC_gc | DMA_CH_DESTRELOAD_NONE_gc | DMA_CH_DESTDIR_FIXED_gc;
+	channel->TRIGSRC = USART_SERIAL_DMA_TRIGGER;
+	channel->DESTADDR0 = (uint8_t)((uint16_t)&comms_usart->DATA);
+	channel->DESTADDR1 = (uint8_t)(((uint16_t)&comms_usart->DATA) >> 8);
+	channel->DESTADDR2 = 0;
+	channel->CTRLA = DMA_CH_SINGLE_bm | DMA_CH_BURSTLEN_1BYTE_gc; //One byte per trigger, channel not enabled yet
+	channel->CTRLB = USART_SERIAL_DMA_INTLVL;
+	pmic_enable_level(USART_SERIAL_DMA_PMIC_LEVEL);
+	
+	tx_use_dma = true;
+}
+
+static void uart_tx_dma_start(void)
+/* Gives the channel the next contiguous span of the queue, if it's idle and there is one.
+Called from the main loop and from the DMA interrupt, so interrupts are held off for the few register writes
+to keep both from starting a span at once. */
+{
+	DMA_CH_t* channel = &USART_SERIAL_DMA_CHANNEL;
+	irqflags_t flags = cpu_irq_save();
+	
+	if (tx_dma_length == 0)
+	{
+		uint16_t length;
+		const uint8_t* span = rbspsc_peek_region(&tx_buffer, &length);
+		if (length)
+		{
+			channel->SRCADDR0 = (uint8_t)((uint16_t)span);
+			channel->SRCADDR1 = (uint8_t)(((uint16_t)span) >> 8);
+			channel->SRCADDR2 = 0;
+			channel->TRFCNT = length;
+			tx_dma_length = length;
+			channel->CTRLA |= DMA_CH_ENABLE_bm;
+		}
+	}
+	
+	cpu_irq_restore(flags);
+}
+
+static void uart_tx_dma_complete(void)
+/* The span has been sent, or the channel hit an error and stopped part way. Free it and start the next one.
+An error isn't retried: the same span would most likely fail the same way and hold up everything queued behind it.
+Instead the bytes the channel didn't get to are counted, see UART_tx_dropped. */
+{
+	DMA_CH_t* channel = &USART_SERIAL_DMA_CHANNEL;
+	if (channel->CTRLB & DMA_CH_ERRIF_bm)
+	{
+		uint16_t unsent = channel->TRFCNT; //Counts down per byte, and the channel stops where the error was
+		tx_dropped += (unsent != 0 && unsent <= tx_dma_length) ? unsent : tx_dma_length;
+	}
+	channel->CTRLB |= DMA_CH_TRNIF_bm | DMA_CH_ERRIF_bm; //Flags clear by writing 1
+	rbspsc_release(&tx_buffer, tx_dma_length);
+	tx_dma_length = 0;
+	uart_tx_dma_start();
+}
+
+uint32_t UART_tx_dropped(void)
+//Number of queued bytes that were never sent because the DMA channel reported an error. Always 0 with UART_tx_interrupt_init
+{
+	irqflags_t flags = cpu_irq_save(); //32 bits take four reads, the interrupt could change it in between
+	uint32_t dropped = tx_dropped;
+	cpu_irq_restore(flags);
+	return dropped;
+}
+
+ISR(USART_SERIAL_DMA_vect)
+{
+	uart_tx_dma_complete();
+}
@@ -8,6 +8,38 @@
 #ifndef UART_TOOLS_H_INCLUDED
 #define UART_TOOLS_H_INCLUDED
 
+#include <asf.h>
+
+typedef struct UART_baud
+{
+	uint32_t requested;
+	uint32_t actual; //What the hardware will really run at with these settings
+	int32_t error_ppm; //(actual - requested) / requested, in parts per million
+	uint16_t bsel;
+	int8_t bscale;
+	bool clk2x;
+} UART_baud_t;
+
 void UART_computer_init(USART_t* comms_usart, PORT_t* comms_port, ioport_pin_t tx_pin, ioport_pin_t rx_pin);
 
+//Baud rate selection
+bool UART_find_baud(uint32_t baud, uint32_t per_hz, UART_baud_t* setting);
+bool UART_set_baudrate(USART_t* comms_usart, uint32_t baud);
+void UART_get_baud(UART_baud_t* setting);
+
+//Interrupt-driven transmit
+void UART_tx_interrupt_init(USART_t* comms_usart, bool redirect_stdio);
+void UART_tx_dma_init(USART_t* comms_usart, bool redirect_stdio);
+uint16_t UART_write(const uint8_t* data, uint16_t length);
+uint16_t UART_tx_free_space(void);
+void UART_tx_flush(void);
+uint32_t UART_tx_dropped(void);
+int UART_putchar_buffered(volatile void* usart, char c);
+
+//Interrupt-driven receive
+void UART_rx_interrupt_init(USART_t* comms_usart);
+uint16_t UART_read(uint8_t* dest, uint16_t length);
+uint16_t UART_rx_length(void);
+uint32_t UART_rx_overruns(void);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,82 @@
+/*
+ * CommandParser.c
+ *
+ * Parses ground station commands. See CommandParser.h for the format.
+ */
+#include "tools/CommandParser.h"
+
+
+void command_parser_init(CommandParser_t* parser)
+{
+	parser->length = 0;
+	parser->overflow = 0;
+}
+
+static uint8_t command_parse_line(const char* line, uint8_t length, Command_t* command)
+/*	Return values
+	* 0 - line was a valid command, now in command
+	* 1 - empty or malformed line
+*/
+{
+	if (length == 0)
+		return 1;
+	
+	char letter = line[0];
+	if (letter >= 'a' && letter <= 'z')
+		letter -= 'a' - 'A';
+	if (letter < 'A' || letter > 'Z')
+		return 1;
+	
+	uint8_t i = 1;
+	uint8_t negative = 0;
+	if (i < length && (line[i] == '-' || line[i] == '+'))
+	{
+		negative = line[i] == '-';
+		i++;
+	}
+	
+	uint8_t digits = 0;
+	uint32_t value = 0;
+	for (; i < length; i++)
+	{
+		if (line[i] < '0' || line[i] > '9' || digits == 9) //9 digits always fit in an int32_t
+			return 1;
+		value = value * 10 + (line[i] - '0');
+		digits++;
+	}
+	if (digits == 0 && negative) //A bare '-' isn't a number
+		return 1;
+	
+	command->letter = letter;
+	command->value = negative ? -(int32_t)value : (int32_t)value;
+	command->has_value = digits != 0;
+	return 0;
+}
+
+uint8_t command_parser_push(CommandParser_t* parser, uint8_t byte, Command_t* command)
+/*	Feed received bytes in one at a time
+	Return values
+	* 0 - no complete command yet (or the line that just ended wasn't a valid command)
+	* 1 - byte finished a valid command, which is now in command
+*/
+{
+	if (byte == '\r' || byte == '\n')
+	{
+		uint8_t length = parser->length;
+		uint8_t overflow = parser->overflow;
+		parser->length = 0;
+		parser->overflow = 0;
+		if (overflow)
+			return 0;
+		return !command_parse_line(parser->line, length, command);
+	}
+	
+	if (byte == ' ' || byte == '\t')
+		return 0;
+	
+	if (parser->length < COMMAND_MAX_LENGTH)
+		parser->line[parser->length++] = (char)byte;
+	else
+		parser->overflow = 1;
+	return 0;
+}
@@ -0,0 +1,36 @@
+/*
+ * CommandParser.h
+ *
+ * Parses ground station commands out of a received byte stream.
+ * A command is one letter followed by an optional signed decimal number, ended by '\r' or '\n':
+ *	"O1024\n"	"R250\n"	"F1\n"
+ * Letters are case-insensitive and always come back upper case. Spaces are ignored.
+ * What each letter means is up to the application; see main.c.
+ */
+
+
+#ifndef COMMANDPARSER_H_
+#define COMMANDPARSER_H_
+
+#include <inttypes.h>
+
+#define COMMAND_MAX_LENGTH	16 //Longer lines are thrown away
+
+typedef struct Command
+{
+	char letter;
+	int32_t value; //0 if no number was given
+	uint8_t has_value;
+} Command_t;
+
+typedef struct CommandParser
+{
+	char line[COMMAND_MAX_LENGTH];
+	uint8_t length;
+	uint8_t overflow;
+} CommandParser_t;
+
+void command_parser_init(CommandParser_t* parser);
+uint8_t command_parser_push(CommandParser_t* parser, uint8_t byte, Command_t* command);
+
+#endif /* COMMANDPARSER_H_ */
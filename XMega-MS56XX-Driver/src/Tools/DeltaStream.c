@@ -0,0 +1,149 @@
+/*
+ * DeltaStream.c
+ *
+ * Delta/varint sample compression. See DeltaStream.h for the record format.
+ */
+#include "tools/DeltaStream.h"
+
+
+//--------------Building blocks--------------------
+uint32_t zigzag_encode(int32_t value)
+{
+	return (((uint32_t)value) << 1) ^ (uint32_t)(value >> 31);
+}
+
+int32_t zigzag_decode(uint32_t value)
+{
+	return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+uint8_t varint_write(uint8_t* dest, uint32_t value)
+//Writes value 7 bits at a time, lowest first. Returns the number of bytes written (1 to 5)
+{
+	uint8_t length = 0;
+	while (value >= 0x80)
+	{
+		dest[length++] = (uint8_t)value | 0x80;
+		value >>= 7;
+	}
+	dest[length++] = (uint8_t)value;
+	return length;
+}
+
+uint8_t varint_read(const uint8_t* src, uint8_t length, uint32_t* value)
+//Returns the number of bytes used, or 0 if src ran out (or went past 5 bytes) before the varint ended
+{
+	uint32_t result = 0;
+	for (uint8_t i = 0; i < length && i < 5; i++)
+	{
+		result |= ((uint32_t)(src[i] & 0x7F)) << (7 * i);
+		if (!(src[i] & 0x80))
+		{
+			*value = result;
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+//--------------Encoding--------------------
+void delta_encoder_init(DeltaEncoder_t* encoder, uint8_t keyframe_interval)
+//The first sample after this is always a keyframe
+{
+	encoder->last_pressure = 0;
+	encoder->last_temperature = 0;
+	encoder->keyframe_interval = keyframe_interval;
+	encoder->since_keyframe = 0;
+	encoder->need_keyframe = 1;
+}
+
+void delta_encoder_force_keyframe(DeltaEncoder_t* encoder)
+//Makes the next sample a keyframe, e.g. at the start of every frame so each one can be decoded on its own
+{
+	encoder->need_keyframe = 1;
+}
+
+uint8_t delta_encode_sample(DeltaEncoder_t* encoder, int32_t pressure, int32_t temperature, uint8_t* dest)
+/*	Writes one record for this sample into dest, which needs DELTA_MAX_RECORD_LENGTH bytes
+	Returns the number of bytes written
+*/
+{
+	//Differences are taken modulo 2^32, so the decoder gets exactly the same values back even if they wrap
+	int32_t pressure_delta = (int32_t)((uint32_t)pressure - (uint32_t)encoder->last_pressure);
+	int32_t temperature_delta = (int32_t)((uint32_t)temperature - (uint32_t)encoder->last_temperature);
+	uint8_t length;
+	
+	if (encoder->keyframe_interval && encoder->since_keyframe >= encoder->keyframe_interval - 1)
+		encoder->need_keyframe = 1;
+	//The pressure delta shares its varint with the keyframe bit, so it has to fit in 30 bits plus sign
+	if (pressure_delta >= (1L << 30) || pressure_delta < -(1L << 30))
+		encoder->need_keyframe = 1;
+	
+	if (encoder->need_keyframe)
+	{
+		length = varint_write(dest, 1);
+		length += varint_write(dest + length, zigzag_encode(pressure));
+		length += varint_write(dest + length, zigzag_encode(temperature));
+		encoder->need_keyframe = 0;
+		encoder->since_keyframe = 0;
+	}
+	else
+	{
+		length = varint_write(dest, zigzag_encode(pressure_delta) << 1);
+		length += varint_write(dest + length, zigzag_encode(temperature_delta));
+		encoder->since_keyframe++;
+	}
+	
+	encoder->last_pressure = pressure;
+	encoder->last_temperature = temperature;
+	return length;
+}
+
+//--------------Decoding--------------------
+void delta_decoder_init(DeltaDecoder_t* decoder)
+{
+	decoder->last_pressure = 0;
+	decoder->last_temperature = 0;
+	decoder->have_keyframe = 0;
+}
+
+uint8_t delta_decode_sample(DeltaDecoder_t* decoder, const uint8_t* src, uint8_t length, int32_t* pressure, int32_t* temperature)
+/*	Decodes the record at the start of src (length bytes available)
+	Returns the number of bytes the record took, or 0 if it's cut off or malformed
+	A delta record that arrives before any keyframe is skipped over: its length is returned but pressure
+	and temperature are left alone. Check have_keyframe to tell the difference
+*/
+{
+	uint32_t tag, second, third;
+	uint8_t used = varint_read(src, length, &tag);
+	if (used == 0)
+		return 0;
+	uint8_t more = varint_read(src + used, length - used, &second);
+	if (more == 0)
+		return 0;
+	used += more;
+	
+	if (tag & 1)
+	{
+		if (tag != 1)
+			return 0;
+		more = varint_read(src + used, length - used, &third);
+		if (more == 0)
+			return 0;
+		used += more;
+		decoder->last_pressure = zigzag_decode(second);
+		decoder->last_temperature = zigzag_decode(third);
+		decoder->have_keyframe = 1;
+	}
+	else
+	{
+		if (!decoder->have_keyframe)
+			return used;
+		decoder->last_pressure = (int32_t)((uint32_t)decoder->last_pressure + (uint32_t)zigzag_decode(tag >> 1));
+		decoder->last_temperature = (int32_t)((uint32_t)decoder->last_temperature + (uint32_t)zigzag_decode(second));
+	}
+	
+	*pressure = decoder->last_pressure;
+	*temperature = decoder->last_temperature;
+	return used;
+}
@@ -0,0 +1,55 @@
+/*
+ * DeltaStream.h
+ *
+ * Compresses a stream of (pressure, temperature) samples by sending how much each changed instead of the full values.
+ * Consecutive samples usually differ by a few counts, so most samples take 2 bytes instead of 8.
+ *
+ * Each sample is one record:
+ *	delta record:	varint(zigzag(dP) << 1)		varint(zigzag(dT))
+ *	keyframe:		varint(1)	varint(zigzag(P))	varint(zigzag(T))
+ * varint is little-endian base 128 (7 bits per byte, high bit set on every byte but the last).
+ * zigzag maps signed to unsigned so small negative numbers stay small: 0, -1, 1, -2 ... -> 0, 1, 2, 3 ...
+ * The low bit of the first varint tells the two apart. Keyframes carry the full values so a decoder
+ * can start (or recover after a lost frame) from them; the encoder emits one every keyframe_interval samples.
+ *
+ * Doesn't depend on anything AVR specific, so the ground station tools build it too.
+ */
+
+
+#ifndef DELTASTREAM_H_
+#define DELTASTREAM_H_
+
+#include <inttypes.h>
+
+#define DELTA_MAX_RECORD_LENGTH		11 //Keyframe: 1 + 5 + 5
+
+typedef struct DeltaEncoder
+{
+	int32_t last_pressure;
+	int32_t last_temperature;
+	uint8_t keyframe_interval; //Samples per keyframe, counting the keyframe. 0 = only when forced
+	uint8_t since_keyframe;
+	uint8_t need_keyframe;
+} DeltaEncoder_t;
+
+typedef struct DeltaDecoder
+{
+	int32_t last_pressure;
+	int32_t last_temperature;
+	uint8_t have_keyframe; //Deltas are meaningless until the first keyframe arrives
+} DeltaDecoder_t;
+
+//Building blocks
+uint32_t zigzag_encode(int32_t value);
+int32_t zigzag_decode(uint32_t value);
+uint8_t varint_write(uint8_t* dest, uint32_t value);
+uint8_t varint_read(const uint8_t* src, uint8_t length, uint32_t* value);
+
+void delta_encoder_init(DeltaEncoder_t* encoder, uint8_t keyframe_interval);
+void delta_encoder_force_keyframe(DeltaEncoder_t* encoder);
+uint8_t delta_encode_sample(DeltaEncoder_t* encoder, int32_t pressure, int32_t temperature, uint8_t* dest);
+
+void delta_decoder_init(DeltaDecoder_t* decoder);
+uint8_t delta_decode_sample(DeltaDecoder_t* decoder, const uint8_t* src, uint8_t length, int32_t* pressure, int32_t* temperature);
+
+#endif /* DELTASTREAM_H_ */
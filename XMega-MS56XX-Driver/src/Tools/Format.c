@@ -0,0 +1,162 @@
+/*
+ * Format.c
+ *
+ * Small integer to text routines. See Format.h
+ */
+#include "tools/Format.h"
+
+
+/*	The AVR has no divide instruction, and a 32 bit divide by 10 in libgcc takes several hundred cycles.
+	Counting how many times each power of ten can be subtracted needs at most 9 subtractions per digit and no divides.
+*/
+static const uint32_t powers_of_ten[] = {
+	1000000000UL, 100000000UL, 10000000UL, 1000000UL, 100000UL, 10000UL, 1000UL, 100UL, 10UL, 1UL
+};
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+uint8_t fmt_u32(char* dest, uint32_t value)
+//Writes value in decimal with no leading zeros. Up to 10 characters
+{
+	uint8_t length = 0;
+	for (uint8_t i = 0; i < 10; i++)
+	{
+		uint32_t power = powers_of_ten[i];
+		char digit = '0';
+		while (value >= power)
+		{
+			value -= power;
+			digit++;
+		}
+		if (digit != '0' || length != 0 || i == 9) //Skip leading zeros, but always write the ones digit
+			dest[length++] = digit;
+	}
+	return length;
+}
+
+uint8_t fmt_i32(char* dest, int32_t value)
+//Writes value in decimal, with a '-' if negative. Up to FORMAT_MAX_I32_LENGTH characters
+{
+	if (value < 0)
+	{
+		dest[0] = '-';
+		return 1 + fmt_u32(dest + 1, -(uint32_t)value); //Negate as unsigned so INT32_MIN works
+	}
+	return fmt_u32(dest, (uint32_t)value);
+}
+
+uint8_t fmt_u32_fixed(char* dest, uint32_t value, uint8_t width, char pad)
+/*	Writes value right-aligned in exactly width characters, padded on the left with pad (usually ' ' or '0')
+	If value needs more than width digits, only the lowest width digits are written
+*/
+{
+	char digits[10];
+	uint8_t length = fmt_u32(digits, value);
+	uint8_t skip = 0;
+	if (length > width)
+	{
+		skip = length - width;
+		length = width;
+	}
+	uint8_t padding = width - length;
+	for (uint8_t i = 0; i < padding; i++)
+		dest[i] = pad;
+	for (uint8_t i = 0; i < length; i++)
+		dest[padding + i] = digits[skip + i];
+	return width;
+}
+
+uint8_t fmt_i32_fixed(char* dest, int32_t value, uint8_t width)
+//Writes value right-aligned in exactly width characters, space padded, with the '-' next to the digits
+{
+	char text[FORMAT_MAX_I32_LENGTH];
+	uint8_t length = fmt_i32(text, value);
+	if (length > width)
+		length = width;
+	uint8_t padding = width - length;
+	for (uint8_t i = 0; i < padding; i++)
+		dest[i] = ' ';
+	for (uint8_t i = 0; i < length; i++)
+		dest[padding + i] = text[i];
+	return width;
+}
+
+uint8_t fmt_hex8(char* dest, uint8_t value)
+//Always 2 characters, upper case, no "0x"
+{
+	dest[0] = hex_digits[value >> 4];
+	dest[1] = hex_digits[value & 0x0F];
+	return 2;
+}
+
+uint8_t fmt_hex16(char* dest, uint16_t value)
+//Always 4 characters
+{
+	fmt_hex8(dest, (uint8_t)(value >> 8));
+	fmt_hex8(dest + 2, (uint8_t)value);
+	return 4;
+}
+
+uint8_t fmt_hex32(char* dest, uint32_t value)
+//Always 8 characters
+{
+	fmt_hex16(dest, (uint16_t)(value >> 16));
+	fmt_hex16(dest + 4, (uint16_t)value);
+	return 8;
+}
+
+uint8_t fmt_string(char* dest, const char* src)
+//Copies a '\0' terminated string, without the '\0'. Up to 255 characters
+{
+	uint8_t length = 0;
+	while (src[length] != '\0' && length < 255)
+	{
+		dest[length] = src[length];
+		length++;
+	}
+	return length;
+}
+
+uint8_t fmt_sample_line(char* dest, int32_t pressure, int32_t temperature, uint8_t valid)
+/*	Writes the same line main.c used to printf, newline included:
+	"Pressure is <pressure>, temperature is <temperature>, Valid|Not valid\n"
+	dest needs FORMAT_MAX_SAMPLE_LINE bytes
+*/
+{
+	uint8_t length = fmt_string(dest, "Pressure is ");
+	length += fmt_i32(dest + length, pressure);
+	length += fmt_string(dest + length, ", temperature is ");
+	length += fmt_i32(dest + length, temperature);
+	length += fmt_string(dest + length, valid ? ", Valid\n" : ", Not valid\n");
+	return length;
+}
+
+//----------------Test functions------------------------
+
+#if defined(DEBUG) && defined(__AVR__)
+#include <stdio.h>
+#include "drivers/Profiler.h"
+
+void benchmark_format(void)
+/*	Formats a spread of sample lines through fmt_sample_line and through snprintf with the same format the text output
+	used before, recording each line in the profiler's PROFILE_FMT_SAMPLE_LINE and PROFILE_SNPRINTF_SAMPLE_LINE regions
+	Only the formatting is timed, not the UART. Read the cycles per line back with the profiler's table (Q0)
+*/
+{
+	static const int32_t pressures[] = {101325, 98765, 120000, 1000, 0, -50, 87654, 110001};
+	static const int32_t temperatures[] = {2007, -4000, 8500, 15, 0, -2147483647, 2500, -1};
+	char line[FORMAT_MAX_SAMPLE_LINE];
+	
+	for (uint8_t i = 0; i < sizeof(pressures) / sizeof(pressures[0]); i++)
+	{
+		uint8_t valid = i & 1;
+		PROFILE_BEGIN(PROFILE_FMT_SAMPLE_LINE);
+		fmt_sample_line(line, pressures[i], temperatures[i], valid);
+		PROFILE_END(PROFILE_FMT_SAMPLE_LINE);
+		
+		PROFILE_BEGIN(PROFILE_SNPRINTF_SAMPLE_LINE);
+		snprintf(line, sizeof(line), "Pressure is %" PRIi32 ", temperature is %" PRIi32 ", %s\n", pressures[i], temperatures[i], valid ? "Valid" : "Not valid");
+		PROFILE_END(PROFILE_SNPRINTF_SAMPLE_LINE);
+	}
+}
+#endif
@@ -0,0 +1,32 @@
+/*
+ * Format.h
+ *
+ * Small integer to text routines, for the hot path where printf's vfprintf is too big and too slow.
+ * None of these write a terminating '\0'; they return the number of characters written so calls can be chained.
+ */
+
+
+#ifndef FORMAT_H_
+#define FORMAT_H_
+
+#include <inttypes.h>
+
+#define FORMAT_MAX_I32_LENGTH	11 //"-2147483648"
+#define FORMAT_MAX_SAMPLE_LINE	64
+
+uint8_t fmt_u32(char* dest, uint32_t value);
+uint8_t fmt_i32(char* dest, int32_t value);
+uint8_t fmt_u32_fixed(char* dest, uint32_t value, uint8_t width, char pad);
+uint8_t fmt_i32_fixed(char* dest, int32_t value, uint8_t width);
+uint8_t fmt_hex8(char* dest, uint8_t value);
+uint8_t fmt_hex16(char* dest, uint16_t value);
+uint8_t fmt_hex32(char* dest, uint32_t value);
+uint8_t fmt_string(char* dest, const char* src);
+
+uint8_t fmt_sample_line(char* dest, int32_t pressure, int32_t temperature, uint8_t valid);
+
+#if defined(DEBUG) && defined(__AVR__)
+void benchmark_format(void);
+#endif
+
+#endif /* FORMAT_H_ */
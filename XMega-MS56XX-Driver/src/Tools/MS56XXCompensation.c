@@ -0,0 +1,99 @@
+/*
+ * MS56XXCompensation.c
+ *
+ * Compensation maths for the MS5607/MS5611. See Drivers/MS56XX.c for where the coefficients come from.
+ */
+#include "tools/MS56XXCompensation.h"
+
+
+uint8_t MS56XX_prom_crc4(const uint16_t* prom)
+/*	CRC-4 over the MS56XX_PROM_WORDS words read from the PROM, as in Measurement Specialties' AN520
+	The CRC's own 4 bits (bottom of word 7) count as 0. Compare the result with prom[7] & 0x000F
+*/
+{
+	uint16_t remainder = 0;
+	for (uint8_t count = 0; count < 2 * MS56XX_PROM_WORDS; count++)
+	{
+		uint16_t word = prom[count >> 1];
+		if (count == 2 * MS56XX_PROM_WORDS - 1)
+			word &= 0xFF00;
+		remainder ^= (count & 1) ? (word & 0x00FF) : (word >> 8);
+		for (uint8_t bit = 0; bit < 8; bit++)
+		{
+			if (remainder & 0x8000)
+				remainder = (remainder << 1) ^ 0x3000;
+			else
+				remainder <<= 1;
+		}
+	}
+	return (remainder >> 12) & 0x000F;
+}
+
+uint8_t MS56XX_compensate(const MS56XX_Calibration_t* calibration, SENSOR_TYPE model, uint32_t rawPressure, uint32_t rawTemp, int32_t* pressure, int32_t* temperature)
+/*	rawPressure - D1
+	rawTemp - D2
+	pressure - written in pascals
+	temperature - written in hundredths of a degree celsius
+	Return values
+	* 0 - success
+	* 1 - unknown model, nothing written
+*/
+{
+	int32_t dT = rawTemp - (int32_t)(((int64_t)calibration->Tref) << 8);
+	int32_t TEMP = (int32_t)(((int32_t)2000) + ((int32_t)(((int64_t)dT) * ((int64_t)calibration->TEMPSENS) >> 23)));
+	
+	int32_t T2 = 0;
+	int64_t OFF2 = 0;
+	int64_t SENS2 = 0;
+	
+	if (TEMP < 2000)
+	{
+		T2 = ((int64_t)dT) * ((int64_t)dT) / ((int64_t)2147483648);
+		OFF2 = ((int64_t)61) * ((int64_t)(TEMP - 2000)) * ((int64_t)(TEMP - 2000)) >> 4;
+		SENS2 = ((int64_t)2) * ((int64_t)(TEMP - 2000)) * ((int64_t)(TEMP - 2000));
+	}
+	else
+	{
+	    T2 = 0;
+		OFF2 = 0;
+		SENS2 = 0;	
+	} 
+	
+	if (TEMP<-1500)
+	{
+		OFF2 += ((int64_t)15) * (((int64_t) TEMP) + ((int64_t) 1500))^2; 
+		SENS2 += ((int64_t) 8) * (((int64_t) TEMP) + ((int64_t) 1500) )^2;
+	}
+	uint8_t offshift1, offshift2, sens_shift1, sens_shift2;
+	switch (model)
+	{
+		case MS5607:
+			offshift1 = 17;
+			offshift2 = 6;
+			sens_shift1 = 16;
+			sens_shift2 = 7;
+			break;
+		case MS5611:
+			offshift1 = 17;
+			offshift2 = 6;
+			sens_shift1 = 16;
+			sens_shift2 = 7;
+			break;
+		default:
+			return 1;
+	}
+	int64_t OFF = (((int64_t)calibration->OFFt1) << offshift1) +
+	((((int64_t)calibration->TCO) * ((int64_t)dT)) >> offshift2);
+	
+	int64_t SENS = (((int64_t)calibration->SENSt1) << sens_shift1) + ((((int64_t)calibration->TCS) * ((int64_t)dT)) >> sens_shift2);
+		
+	TEMP -= T2;
+	OFF -= OFF2;
+	SENS -= SENS2;
+	
+	int64_t PRESSURE = ((((int64_t)rawPressure) * SENS >> 21) - OFF) >> 15;
+	
+	*pressure = (int32_t) PRESSURE; //In pascals
+	*temperature = TEMP; //In hundredths of degree celsius
+	return 0;
+}
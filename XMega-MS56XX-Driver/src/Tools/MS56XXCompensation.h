@@ -0,0 +1,36 @@
+/*
+ * MS56XXCompensation.h
+ *
+ * Turns raw MS5607/MS5611 readings (D1, D2) into pressure and temperature using the sensor's PROM coefficients.
+ * Split out of the driver so the ground station tools can recompensate raw samples with exactly the same maths.
+ *
+ * Doesn't depend on anything AVR specific.
+ */
+
+
+#ifndef MS56XXCOMPENSATION_H_
+#define MS56XXCOMPENSATION_H_
+
+#include <inttypes.h>
+
+typedef enum {
+	MS5607 = 1,
+	MS5611 = 2
+} SENSOR_TYPE;
+
+typedef struct MS56XX_Calibration
+{
+	uint16_t SENSt1; //C1
+	uint16_t OFFt1; //C2
+	uint16_t TCS; //You can guess
+	uint16_t TCO;
+	uint16_t Tref;
+	uint16_t TEMPSENS;
+} MS56XX_Calibration_t;
+
+#define MS56XX_PROM_WORDS	8 //Word 0 is factory data, 1 - 6 are C1 - C6, the low 4 bits of word 7 are a CRC over all of it
+
+uint8_t MS56XX_prom_crc4(const uint16_t* prom);
+uint8_t MS56XX_compensate(const MS56XX_Calibration_t* calibration, SENSOR_TYPE model, uint32_t rawPressure, uint32_t rawTemp, int32_t* pressure, int32_t* temperature);
+
+#endif /* MS56XXCOMPENSATION_H_ */
@@ -6,8 +6,104 @@
  */ 
 #include "tools/RingBuffer.h"
 #include <asf.h>
+#include <string.h>
 
 
+//--------------Statistics--------------------
+void rb_stats_reset(RingBufferStats_t* stats)
+/*	Clears the statistics. For a RingBufferSPSC_t, only with both sides stopped
+	Bytes already stored when this is called have no span, so their age isn't measured
+*/
+{
+	memset(stats, 0, sizeof(RingBufferStats_t));
+}
+
+#ifdef RINGBUFFER_STATS_TIME
+uint32_t RINGBUFFER_STATS_TIME(void); //See conf_ringbuffer.h
+#endif
+
+#ifdef RINGBUFFER_STATS
+static uint8_t rb_stats_next_span(uint8_t span)
+{
+	return (span + 1 == RINGBUFFER_STATS_SPANS) ? 0 : span + 1;
+}
+#endif
+
+static void rb_stats_added(RingBufferStats_t* stats, uint16_t length_after, uint16_t added, uint16_t dropped)
+/*	Call after data goes into a buffer. Only touches the fields the adding side owns
+	length_after - stored bytes after the write
+	added - bytes that went into the stream, dropped - bytes lost to a full buffer
+	Each write that adds something starts a span, timestamped so the reader can tell how old its oldest byte is
+	If every span slot is taken, the bytes join the newest span and their age comes out high rather than low
+	Does nothing unless RINGBUFFER_STATS is defined
+*/
+{
+#ifdef RINGBUFFER_STATS
+	if (added)
+	{
+		uint8_t head = stats->span_head;
+		uint8_t next = rb_stats_next_span(head);
+		if (next != stats->span_tail)
+		{
+			stats->span_start[head] = stats->bytes_in;
+#ifdef RINGBUFFER_STATS_TIME
+			stats->span_time[head] = RINGBUFFER_STATS_TIME();
+#endif
+			barrier();
+			stats->span_head = next;
+		}
+	}
+	stats->bytes_in += added;
+	stats->overrun_count += dropped;
+	if (length_after > stats->high_water)
+		stats->high_water = length_after;
+#endif
+}
+
+static void rb_stats_skipped(RingBufferStats_t* stats, uint16_t skipped)
+//Call when bytes leave a buffer without being read, i.e. overwritten. Does nothing unless RINGBUFFER_STATS is defined
+{
+#ifdef RINGBUFFER_STATS
+	stats->tail_position += skipped;
+#endif
+}
+
+static void rb_stats_removed(RingBufferStats_t* stats, uint16_t removed)
+/*	Call after a reader removes data from a buffer. Only touches the fields the reading side owns
+	The age recorded is that of the oldest byte removed, found from the span it was written in
+	Does nothing unless RINGBUFFER_STATS is defined
+*/
+{
+#ifdef RINGBUFFER_STATS
+	if (removed == 0)
+		return;
+	uint8_t head = stats->span_head;
+	uint8_t tail = stats->span_tail;
+	uint8_t next;
+	//The last span is kept even when it's used up, because only the writer knows where it ends
+	while ((next = rb_stats_next_span(tail)) != head && (int32_t)(stats->tail_position - stats->span_start[next]) >= 0)
+		tail = next;
+#ifdef RINGBUFFER_STATS_TIME
+	if (tail != head)
+	{
+		uint32_t age = RINGBUFFER_STATS_TIME() - stats->span_time[tail];
+		if (age > stats->max_age)
+			stats->max_age = age;
+	}
+#endif
+	stats->span_tail = tail;
+	stats->tail_position += removed;
+	stats->bytes_out += removed;
+#endif
+}
+
+#ifdef RINGBUFFER_STATS
+#define RB_STATS(buffer)	(&(buffer)->stats)
+#else
+#define RB_STATS(buffer)	((RingBufferStats_t*)0)
+#endif
+
+//--------------Unsigned 8 bit functions--------------------
 void rbu8_print(RingBufferu8_t* buffer, const char* data)
 {
 	uint8_t i;
@@ -19,30 +115,53 @@ void rbu8_print(RingBufferu8_t* buffer, const char* data)
 	rbu8_write(buffer, data, i);
 }
 void rbu8_write(RingBufferu8_t* buffer, const uint8_t* data, uint16_t length)
-/* Adds length bytes, taken from the data argument, to the end of buffer */
+/*	Adds length bytes, taken from the data argument, to the end of buffer
+	If there isn't room, the oldest data is overwritten, same as writing one byte at a time would
+	The copy is done in at most two memcpy calls: head to the end of the array, then the start of the array
+*/
 // Author: William Hankins
 {
-	for (uint8_t i = 0; i < length; i++)
+	uint16_t capacity = buffer->array_length - 1; //One slot is always left open so that head == tail means empty
+	uint16_t length_before = rbu8_length(buffer);
+	uint16_t free_space = capacity - length_before;
+	uint16_t requested = length;
+	
+	if (length > capacity) //Only the newest capacity bytes would survive anyway
 	{
-		buffer->buffer[buffer->head] = data[i]; // data can be not be access greater length-1
-		buffer->head++;
-		
-		if (buffer->head == buffer->array_length) //Next value to write to is beyond the end of the array
-		{
-			buffer->head = 0;
-		} // end if
-		
-		if (buffer->head == buffer->tail)
-		{
-			buffer->tail++;
-			
-			if (buffer->tail == buffer->array_length){
-				buffer->tail = 0;
-			}// end if
-		} // end if
-	} // end for
+		data += length - capacity;
+		length = capacity;
+	}
+	
+	uint16_t first_segment = min(length, buffer->array_length - buffer->head);
+	memcpy(&buffer->buffer[buffer->head], data, first_segment);
+	memcpy(buffer->buffer, data + first_segment, length - first_segment);
+	
+	buffer->head += length;
+	if (buffer->head >= buffer->array_length)
+		buffer->head -= buffer->array_length;
+	
+	if (length > free_space) //Overwrote the oldest data, so the oldest remaining byte is right after head
+	{
+		buffer->tail = buffer->head + 1;
+		if (buffer->tail == buffer->array_length)
+			buffer->tail = 0;
+	}
+	
+	uint16_t dropped = (requested > free_space) ? requested - free_space : 0;
+	rb_stats_skipped(RB_STATS(buffer), dropped);
+	rb_stats_added(RB_STATS(buffer), rbu8_length(buffer), requested, dropped);
 } // end write_to_ring_buffer
 
+static void rbu8_copy_out(RingBufferu8_t* buffer, uint16_t start, uint8_t* dest, uint16_t length)
+/*	Copies length bytes out of the backing array, starting at index start and wrapping around the end if needed
+	Does not check that the bytes are actually stored in the buffer, callers do that
+*/
+{
+	uint16_t first_segment = min(length, buffer->array_length - start);
+	memcpy(dest, &buffer->buffer[start], first_segment);
+	memcpy(dest + first_segment, buffer->buffer, length - first_segment);
+}
+
 void rbu8_init(RingBufferu8_t* buffer, uint8_t* backing_array, uint16_t backing_array_length)
 /*	Call to reset the head and tail variables of a RingBuffer. 
 	backing_array is the array that the ring buffer actually stores its data in
@@ -53,45 +172,66 @@ void rbu8_init(RingBufferu8_t* buffer, uint8_t* backing_array, uint16_t backing_
 	buffer->tail = 0; //End of array
 	buffer->buffer = backing_array;
 	buffer->array_length = backing_array_length;
+#ifdef RINGBUFFER_STATS
+	rb_stats_reset(&buffer->stats);
+#endif
 }
 
 uint8_t rbu8_read(RingBufferu8_t* buffer, uint8_t* dest, uint16_t length)
-/*	Reads length bytes of data from the bottom of buffer.
+/*	Reads length bytes of data from the bottom of buffer. The data stays in the buffer.
 	dest - resulting data will be stored there. Must be at least length bytes long
 	length - number of bytes to be read
 	Return values
 	* 0 - success
-	* 1 - the buffer doesn't have length bytes of data in it, but dest now has everything that was in there, null-terminated
+	* 1 - the buffer doesn't have length bytes of data in it, but dest now has everything that was in there
 */
 {
-	uint16_t index = buffer->tail;
-	uint16_t i = 0;
-	for (i = 0; i < min(rbu8_length(buffer), length); i++)
-	{
-
-		dest[i] = buffer->buffer[index];
-		if (index == buffer->array_length - 1) //Reset if we've hit the end
-		{
-			index = 0;
-		}
-		else
-		{
-			index++;
-		}
-		
-	}
-	if (length > rbu8_length(buffer))
+	uint16_t stored = rbu8_length(buffer);
+	rbu8_copy_out(buffer, buffer->tail, dest, min(stored, length));
+	if (length > stored)
 		return 1;
 	else
 		return 0;
 }
 
+uint16_t rbu8_peek(RingBufferu8_t* buffer, uint8_t* dest, uint16_t offset, uint16_t length)
+/*	Copies up to length bytes into dest, starting offset bytes after the oldest byte in the buffer
+	Nothing is removed from the buffer, so this can be used to look at a header before deciding to read a whole record
+	Returns the number of bytes actually copied, which is less than length if the buffer runs out
+*/
+{
+	uint16_t stored = rbu8_length(buffer);
+	if (offset >= stored)
+		return 0;
+	length = min(length, stored - offset);
+	
+	uint16_t start = buffer->tail + offset;
+	if (start >= buffer->array_length)
+		start -= buffer->array_length;
+	rbu8_copy_out(buffer, start, dest, length);
+	return length;
+}
+
+uint16_t rbu8_read_and_consume(RingBufferu8_t* buffer, uint8_t* dest, uint16_t length)
+/*	Same as rbu8_read, but the bytes that were read are removed from the buffer
+	Returns the number of bytes actually read, which is less than length if the buffer didn't have that many
+*/
+{
+	length = rbu8_peek(buffer, dest, 0, length);
+	buffer->tail += length;
+	if (buffer->tail >= buffer->array_length)
+		buffer->tail -= buffer->array_length;
+	rb_stats_removed(RB_STATS(buffer), length);
+	return length;
+}
+
 void rbu8_delete_oldest(RingBufferu8_t* buffer, uint16_t length)
 /*	Deletes data from the ring buffer
 	All it really has to do is move buffer->tail up length bytes or until one byte below buffer->head, whichever is lower
 */
 {
 	uint16_t move_distance = min(length, rbu8_length(buffer));
+	rb_stats_removed(RB_STATS(buffer), move_distance);
 	if (move_distance >= rbu8_length(buffer))
 	{
 		buffer->tail = (buffer->tail + move_distance) % buffer->array_length; //Modulus is so that we don't point to above the buffer's location
@@ -138,6 +278,53 @@ uint8_t rbu8_get_nth(RingBufferu8_t* buffer, uint16_t index)
 		return buffer->buffer[buffer->array_length - 1 - index + buffer->head];
 }
 
+uint8_t* rbu8_reserve(RingBufferu8_t* buffer, uint16_t* length)
+/*	Returns a pointer to the free space right after the newest byte, so data can be built in place
+	length - set to how many bytes can be written at that pointer. This only covers the space up to
+		the end of the backing array (or up to the oldest data), so it can be less than the total free space
+	Call rbu8_commit with the number of bytes actually written. Nothing is overwritten by this, unlike rbu8_write
+*/
+{
+	uint16_t end;
+	if (buffer->head >= buffer->tail)
+		end = (buffer->tail == 0) ? buffer->array_length - 1 : buffer->array_length; //Keep the slot before tail open
+	else
+		end = buffer->tail - 1;
+	*length = end - buffer->head;
+	return &buffer->buffer[buffer->head];
+}
+
+void rbu8_commit(RingBufferu8_t* buffer, uint16_t length)
+/*	Adds length bytes that were written at the pointer from rbu8_reserve
+	length must not be more than rbu8_reserve said was available
+*/
+{
+	buffer->head += length;
+	if (buffer->head >= buffer->array_length)
+		buffer->head -= buffer->array_length;
+	rb_stats_added(RB_STATS(buffer), rbu8_length(buffer), length, 0);
+}
+
+const uint8_t* rbu8_peek_region(RingBufferu8_t* buffer, uint16_t* length)
+/*	Returns a pointer to the oldest data, so it can be sent or parsed without copying it out
+	length - set to how many bytes are stored contiguously at that pointer. If the data wraps around
+		the end of the backing array, this is only the first part; release it and call again for the rest
+	Call rbu8_release once the data is no longer needed
+*/
+{
+	if (buffer->head >= buffer->tail)
+		*length = buffer->head - buffer->tail;
+	else
+		*length = buffer->array_length - buffer->tail;
+	return &buffer->buffer[buffer->tail];
+}
+
+void rbu8_release(RingBufferu8_t* buffer, uint16_t length)
+//Removes length bytes that were handed out by rbu8_peek_region
+{
+	rbu8_delete_oldest(buffer, length);
+}
+
 //--------------16 bit signed functions--------------------
 void rb16_write(RingBuffer16_t* buffer, const int16_t* data, uint16_t length)
 /* Adds length bytes, taken from the data argument, to the end of buffer */
@@ -382,12 +569,670 @@ int32_t rb32_get_nth(RingBuffer32_t* buffer, uint16_t index)
 		return buffer->buffer[buffer->array_length - 1 - index + buffer->head];
 }
 
+//--------------Windowed statistics functions--------------------
+void rb32agg_init(RingBuffer32Agg_t* agg, int32_t* backing_array, uint16_t* min_queue_array, uint16_t* max_queue_array, uint16_t backing_array_length)
+/*	Call to reset a windowed statistics buffer
+	backing_array, min_queue_array and max_queue_array must all be backing_array_length long
+	The window holds the last backing_array_length - 1 values pushed
+*/
+{
+	rb32_init(&agg->window, backing_array, backing_array_length);
+	agg->offset = 0;
+	agg->sum = 0;
+	agg->sum_squares = 0;
+	agg->min_queue = min_queue_array;
+	agg->max_queue = max_queue_array;
+	agg->min_front = 0;
+	agg->min_count = 0;
+	agg->max_front = 0;
+	agg->max_count = 0;
+}
+
+static uint16_t rb32agg_queue_back(RingBuffer32Agg_t* agg, uint16_t front, uint16_t count)
+//Index of the last entry in a monotonic queue. Queues are circular over window.array_length entries
+{
+	uint16_t back = front + count - 1;
+	if (back >= agg->window.array_length)
+		back -= agg->window.array_length;
+	return back;
+}
+
+void rb32agg_push(RingBuffer32Agg_t* agg, int32_t value)
+/*	Adds value to the window, dropping the oldest value if the window is full
+	Constant time apart from the queue pops, which average out to at most one each per push
+*/
+{
+	RingBuffer32_t* window = &agg->window;
+	uint16_t position = window->head;
+	int64_t relative;
+	
+	if (rb32_length(window) == 0)
+		agg->offset = value;
+	else if (rb32_length(window) == window->array_length - 1) //Full, so the value at tail is about to be overwritten
+	{
+		relative = (int64_t)window->buffer[window->tail] - agg->offset;
+		agg->sum -= relative;
+		agg->sum_squares -= relative * relative;
+		
+		if (agg->min_count && agg->min_queue[agg->min_front] == window->tail)
+		{
+			agg->min_front = (agg->min_front + 1 == window->array_length) ? 0 : agg->min_front + 1;
+			agg->min_count--;
+		}
+		if (agg->max_count && agg->max_queue[agg->max_front] == window->tail)
+		{
+			agg->max_front = (agg->max_front + 1 == window->array_length) ? 0 : agg->max_front + 1;
+			agg->max_count--;
+		}
+	}
+	
+	rb32_write(window, &value, 1);
+	relative = (int64_t)value - agg->offset;
+	agg->sum += relative;
+	agg->sum_squares += relative * relative;
+	
+	//Anything at the back of the min queue that isn't smaller than value can never be the minimum again
+	while (agg->min_count && window->buffer[agg->min_queue[rb32agg_queue_back(agg, agg->min_front, agg->min_count)]] >= value)
+		agg->min_count--;
+	agg->min_count++;
+	agg->min_queue[rb32agg_queue_back(agg, agg->min_front, agg->min_count)] = position;
+	
+	while (agg->max_count && window->buffer[agg->max_queue[rb32agg_queue_back(agg, agg->max_front, agg->max_count)]] <= value)
+		agg->max_count--;
+	agg->max_count++;
+	agg->max_queue[rb32agg_queue_back(agg, agg->max_front, agg->max_count)] = position;
+}
+
+uint16_t rb32agg_length(RingBuffer32Agg_t* agg)
+//Returns the number of values currently in the window
+{
+	return rb32_length(&agg->window);
+}
+
+int64_t rb32agg_sum(RingBuffer32Agg_t* agg)
+//Returns the sum of every value in the window
+{
+	return agg->sum + ((int64_t)agg->offset) * rb32agg_length(agg);
+}
+
+int32_t rb32agg_mean(RingBuffer32Agg_t* agg)
+//Returns the average of the window, rounded toward the first value pushed. 0 if the window is empty
+{
+	uint16_t count = rb32agg_length(agg);
+	if (count == 0)
+		return 0;
+	return agg->offset + (int32_t)(agg->sum / count);
+}
+
+int64_t rb32agg_variance(RingBuffer32Agg_t* agg)
+/*	Returns the population variance of the window, in the data's units squared. 0 if the window is empty
+	Uses (n * sum of squares - sum^2) / n^2 on the offset values, so it is exact apart from the final division
+*/
+{
+	uint16_t count = rb32agg_length(agg);
+	if (count == 0)
+		return 0;
+	return (agg->sum_squares * count - agg->sum * agg->sum) / ((int64_t)count * count);
+}
+
+int32_t rb32agg_min(RingBuffer32Agg_t* agg)
+//Returns the smallest value in the window. Check rb32agg_length first, an empty window returns garbage
+{
+	return agg->window.buffer[agg->min_queue[agg->min_front]];
+}
+
+int32_t rb32agg_max(RingBuffer32Agg_t* agg)
+//Returns the largest value in the window. Check rb32agg_length first, an empty window returns garbage
+{
+	return agg->window.buffer[agg->max_queue[agg->max_front]];
+}
+
+//--------------Single producer/single consumer functions--------------------
+/*	head is only written by the producer and tail only by the consumer, so each side owns one index.
+	The AVR moves 16 bit values one byte at a time, so a read racing a write could see one new byte and one old one,
+	whichever side is the ISR. rbspsc_init only takes backing arrays of up to RBSPSC_MAX_ARRAY_LENGTH bytes,
+	which keeps the high byte of both indices at 0: only the low byte ever changes, and that is moved in one go.
+	rbspsc_load_index marks the places the other side's index is read, and the owner of an index reads it directly.
+	barrier() keeps the compiler from moving the data copy past the index update that publishes it.
+*/
+static uint16_t rbspsc_load_index(volatile uint16_t* index)
+{
+	return *index;
+}
+
+static uint16_t rbspsc_used(RingBufferSPSC_t* buffer, uint16_t head, uint16_t tail)
+//Same math as rbu8_length, with the indices passed in so each side can decide how to load them
+{
+	if (head >= tail)
+		return head - tail;
+	else
+		return buffer->array_length - (tail - head);
+}
+
+uint8_t rbspsc_init(RingBufferSPSC_t* buffer, uint8_t* backing_array, uint16_t backing_array_length)
+/*	Call before the producer and consumer are started (i.e. before enabling the interrupt that uses it)
+	One byte of backing_array is always left empty, so the buffer holds backing_array_length - 1 bytes
+	Return values
+	* 0 - success
+	* 1 - backing_array_length is over RBSPSC_MAX_ARRAY_LENGTH (see rbspsc_load_index). The buffer
+		  is still safe to use but holds nothing, so every write is refused
+*/
+{
+	uint8_t status = 0;
+	if (backing_array_length > RBSPSC_MAX_ARRAY_LENGTH)
+	{
+		backing_array_length = 1;
+		status = 1;
+	}
+	buffer->head = 0;
+	buffer->tail = 0;
+	buffer->buffer = backing_array;
+	buffer->array_length = backing_array_length;
+#ifdef RINGBUFFER_STATS
+	rb_stats_reset(&buffer->stats);
+#endif
+	return status;
+}
+
+uint16_t rbspsc_free_space(RingBufferSPSC_t* buffer)
+//Producer side. Returns how many bytes can be written before the buffer is full
+{
+	return buffer->array_length - 1 - rbspsc_used(buffer, buffer->head, rbspsc_load_index(&buffer->tail));
+}
+
+uint8_t rbspsc_put(RingBufferSPSC_t* buffer, uint8_t data)
+/*	Producer side. Adds one byte
+	Return values
+	* 0 - success
+	* 1 - buffer full, data was dropped
+*/
+{
+	uint16_t head = buffer->head;
+	uint16_t tail = rbspsc_load_index(&buffer->tail);
+	uint16_t next = head + 1;
+	if (next == buffer->array_length)
+		next = 0;
+	if (next == tail)
+	{
+		rb_stats_added(RB_STATS(buffer), 0, 0, 1);
+		return 1;
+	}
+	
+	buffer->buffer[head] = data;
+	barrier();
+	buffer->head = next;
+	
+	rb_stats_added(RB_STATS(buffer), rbspsc_used(buffer, head, tail) + 1, 1, 0);
+	return 0;
+}
+
+uint16_t rbspsc_write(RingBufferSPSC_t* buffer, const uint8_t* data, uint16_t length)
+/*	Producer side. Adds as much of data as fits, in at most two copies
+	Returns the number of bytes actually written
+*/
+{
+	uint16_t head = buffer->head;
+	uint16_t free_space = rbspsc_free_space(buffer);
+	uint16_t requested = length;
+	length = min(length, free_space);
+	
+	uint16_t first_segment = min(length, buffer->array_length - head);
+	memcpy(&buffer->buffer[head], data, first_segment);
+	memcpy(buffer->buffer, data + first_segment, length - first_segment);
+	
+	head += length;
+	if (head >= buffer->array_length)
+		head -= buffer->array_length;
+	barrier();
+	buffer->head = head;
+	
+	rb_stats_added(RB_STATS(buffer), buffer->array_length - 1 - free_space + length, length, requested - length);
+	return length;
+}
+
+uint8_t* rbspsc_reserve(RingBufferSPSC_t* buffer, uint16_t* length)
+/*	Producer side. Same as rbu8_reserve: returns a pointer to contiguous free space and sets length to its size
+	Call rbspsc_commit to hand the bytes to the consumer. The consumer can't see anything until then
+*/
+{
+	uint16_t head = buffer->head;
+	uint16_t tail = rbspsc_load_index(&buffer->tail);
+	uint16_t end;
+	if (head >= tail)
+		end = (tail == 0) ? buffer->array_length - 1 : buffer->array_length;
+	else
+		end = tail - 1;
+	*length = end - head;
+	return &buffer->buffer[head];
+}
+
+void rbspsc_commit(RingBufferSPSC_t* buffer, uint16_t length)
+//Producer side. Publishes length bytes written at the pointer from rbspsc_reserve
+{
+	uint16_t length_before = rbspsc_used(buffer, buffer->head, rbspsc_load_index(&buffer->tail));
+	uint16_t head = buffer->head + length;
+	if (head >= buffer->array_length)
+		head -= buffer->array_length;
+	barrier();
+	buffer->head = head;
+	rb_stats_added(RB_STATS(buffer), length_before + length, length, 0);
+}
+
+uint16_t rbspsc_length(RingBufferSPSC_t* buffer)
+//Consumer side. Returns the number of bytes waiting to be read
+{
+	return rbspsc_used(buffer, rbspsc_load_index(&buffer->head), buffer->tail);
+}
+
+const uint8_t* rbspsc_peek_region(RingBufferSPSC_t* buffer, uint16_t* length)
+/*	Consumer side. Same as rbu8_peek_region: returns a pointer to the oldest data and sets length
+	to how much of it is contiguous. The producer won't touch it until rbspsc_release is called
+*/
+{
+	uint16_t head = rbspsc_load_index(&buffer->head);
+	uint16_t tail = buffer->tail;
+	if (head >= tail)
+		*length = head - tail;
+	else
+		*length = buffer->array_length - tail;
+	return &buffer->buffer[tail];
+}
+
+void rbspsc_release(RingBufferSPSC_t* buffer, uint16_t length)
+//Consumer side. Frees length bytes handed out by rbspsc_peek_region so the producer can reuse them
+{
+	uint16_t tail = buffer->tail + length;
+	if (tail >= buffer->array_length)
+		tail -= buffer->array_length;
+	barrier();
+	buffer->tail = tail;
+	rb_stats_removed(RB_STATS(buffer), length);
+}
+
+#ifdef RINGBUFFER_STATS
+void rbspsc_get_stats(RingBufferSPSC_t* buffer, RingBufferStats_t* stats)
+/*	Either side. Copies the statistics with interrupts held off, so the 32 bit counters the other side
+	owns can't change half way through being read
+*/
+{
+	irqflags_t flags = cpu_irq_save();
+	memcpy(stats, &buffer->stats, sizeof(RingBufferStats_t));
+	cpu_irq_restore(flags);
+}
+#endif
+
+uint8_t rbspsc_get(RingBufferSPSC_t* buffer, uint8_t* dest)
+/*	Consumer side. Removes the oldest byte and stores it in dest
+	Return values
+	* 0 - success
+	* 1 - buffer empty, dest is untouched
+*/
+{
+	uint16_t tail = buffer->tail;
+	if (tail == rbspsc_load_index(&buffer->head))
+		return 1;
+	
+	*dest = buffer->buffer[tail];
+	barrier();
+	tail++;
+	if (tail == buffer->array_length)
+		tail = 0;
+	buffer->tail = tail;
+	rb_stats_removed(RB_STATS(buffer), 1);
+	return 0;
+}
+
+uint16_t rbspsc_read(RingBufferSPSC_t* buffer, uint8_t* dest, uint16_t length)
+/*	Consumer side. Removes up to length bytes, oldest first, in at most two copies
+	Returns the number of bytes actually read
+*/
+{
+	uint16_t tail = buffer->tail;
+	length = min(length, rbspsc_length(buffer));
+	
+	uint16_t first_segment = min(length, buffer->array_length - tail);
+	memcpy(dest, &buffer->buffer[tail], first_segment);
+	memcpy(dest + first_segment, buffer->buffer, length - first_segment);
+	
+	tail += length;
+	if (tail >= buffer->array_length)
+		tail -= buffer->array_length;
+	barrier();
+	buffer->tail = tail;
+	rb_stats_removed(RB_STATS(buffer), length);
+	return length;
+}
+
+//--------------Broadcast (one writer, several readers) functions--------------------
+void rbbc_init(RingBufferBroadcast_t* buffer, uint8_t* backing_array, uint16_t backing_array_length)
+/*	Call to reset a broadcast buffer. It starts with no readers; add them with rbbc_add_reader
+	One byte of backing_array is always left empty, so the buffer holds backing_array_length - 1 bytes
+*/
+{
+	buffer->head = 0;
+	buffer->reader_count = 0;
+	buffer->buffer = backing_array;
+	buffer->array_length = backing_array_length;
+}
+
+uint8_t rbbc_add_reader(RingBufferBroadcast_t* buffer)
+/*	Registers a new reader and returns its number, to be passed to rbbc_read and friends
+	The reader only sees data written after this call
+	Returns RB_BROADCAST_NO_READER if RB_BROADCAST_MAX_READERS readers already exist
+*/
+{
+	if (buffer->reader_count >= RB_BROADCAST_MAX_READERS)
+		return RB_BROADCAST_NO_READER;
+	buffer->tails[buffer->reader_count] = buffer->head;
+	return buffer->reader_count++;
+}
+
+uint16_t rbbc_length(RingBufferBroadcast_t* buffer, uint8_t reader)
+//Returns the number of bytes reader hasn't read yet
+{
+	uint16_t tail = buffer->tails[reader];
+	if (buffer->head >= tail)
+		return buffer->head - tail;
+	else
+		return buffer->array_length - (tail - buffer->head);
+}
+
+uint16_t rbbc_free_space(RingBufferBroadcast_t* buffer)
+//Returns how many bytes can be written without overwriting anything the slowest reader still needs
+{
+	uint16_t most_unread = 0;
+	for (uint8_t i = 0; i < buffer->reader_count; i++)
+	{
+		most_unread = max(most_unread, rbbc_length(buffer, i));
+	}
+	return buffer->array_length - 1 - most_unread;
+}
+
+uint8_t rbbc_lagging_readers(RingBufferBroadcast_t* buffer, uint16_t length)
+/*	Returns a bitmask of the readers that would have to give up data for length more bytes to fit
+	Bit n set = reader n is lagging. 0 means a write of length bytes would succeed
+	The writer can rbbc_skip a lagging reader forward if fresh data matters more than what that reader missed
+*/
+{
+	uint8_t lagging = 0;
+	for (uint8_t i = 0; i < buffer->reader_count; i++)
+	{
+		if (rbbc_length(buffer, i) + length > buffer->array_length - 1)
+			lagging |= 1 << i;
+	}
+	return lagging;
+}
+
+uint8_t rbbc_write(RingBufferBroadcast_t* buffer, const uint8_t* data, uint16_t length)
+/*	Adds length bytes for every reader to see. The write is all or nothing so records never get split
+	Return values
+	* 0 - success
+	* 1 - not enough room for every reader, nothing was written. See rbbc_lagging_readers
+*/
+{
+	if (length > rbbc_free_space(buffer))
+		return 1;
+	
+	uint16_t first_segment = min(length, buffer->array_length - buffer->head);
+	memcpy(&buffer->buffer[buffer->head], data, first_segment);
+	memcpy(buffer->buffer, data + first_segment, length - first_segment);
+	
+	buffer->head += length;
+	if (buffer->head >= buffer->array_length)
+		buffer->head -= buffer->array_length;
+	return 0;
+}
+
+uint16_t rbbc_read(RingBufferBroadcast_t* buffer, uint8_t reader, uint8_t* dest, uint16_t length)
+/*	Removes up to length bytes, oldest first, from reader's view of the buffer. Other readers still see them
+	Returns the number of bytes actually read
+*/
+{
+	uint16_t tail = buffer->tails[reader];
+	length = min(length, rbbc_length(buffer, reader));
+	
+	uint16_t first_segment = min(length, buffer->array_length - tail);
+	memcpy(dest, &buffer->buffer[tail], first_segment);
+	memcpy(dest + first_segment, buffer->buffer, length - first_segment);
+	
+	rbbc_skip(buffer, reader, length);
+	return length;
+}
+
+void rbbc_skip(RingBufferBroadcast_t* buffer, uint8_t reader, uint16_t length)
+//Throws away up to length bytes from reader's view of the buffer without copying them anywhere
+{
+	length = min(length, rbbc_length(buffer, reader));
+	uint16_t tail = buffer->tails[reader] + length;
+	if (tail >= buffer->array_length)
+		tail -= buffer->array_length;
+	buffer->tails[reader] = tail;
+}
+
 //----------------Test functions------------------------
 
 #ifdef DEBUG
 
+static uint8_t rb_test_failures;
+
+static void rb_check(uint8_t passed, const char* what)
+//Prints what failed and counts it, so one run shows every broken case instead of stopping at the first
+{
+	if (!passed)
+	{
+		printf("FAIL: %s\n", what);
+		rb_test_failures++;
+	}
+}
+
+static uint8_t rb_check_sequence(const uint8_t* data, uint8_t first, uint16_t length)
+//1 if data holds first, first + 1, ... for length bytes
+{
+	for (uint16_t i = 0; i < length; i++)
+	{
+		if (data[i] != (uint8_t)(first + i))
+			return 0;
+	}
+	return 1;
+}
+
+static void test_ring_bufferu8_wraparound(void)
+//rbu8_write, rbu8_peek and rbu8_read_and_consume with data split across the end of the backing array
+{
+	uint8_t backing_array[8]; //Holds 7
+	uint8_t data[12], read[12];
+	RingBufferu8_t rb;
+	for (uint8_t i = 0; i < sizeof(data); i++)
+		data[i] = i;
+	
+	rbu8_init(&rb, backing_array, sizeof(backing_array));
+	rbu8_write(&rb, data, 5);
+	rb_check(rbu8_read_and_consume(&rb, read, 4) == 4 && rb_check_sequence(read, 0, 4), "rbu8 consume before wrap");
+	
+	//tail = 4, head = 5, so 6 more bytes go in as 5..7 then 0..2
+	rbu8_write(&rb, &data[5], 6);
+	rb_check(rb.head == 3 && rb.tail == 4 && rbu8_length(&rb) == 7, "rbu8 two segment write indices");
+	rb_check(backing_array[5] == 5 && backing_array[7] == 7 && backing_array[0] == 8 && backing_array[2] == 10, "rbu8 two segment write data");
+	
+	rb_check(rbu8_peek(&rb, read, 2, 4) == 4 && rb_check_sequence(read, 6, 4), "rbu8 peek across the wrap");
+	rb_check(rbu8_peek(&rb, read, 5, 10) == 2 && rb_check_sequence(read, 9, 2), "rbu8 peek cut short at the newest byte");
+	rb_check(rbu8_peek(&rb, read, 7, 1) == 0, "rbu8 peek past the end");
+	rb_check(rbu8_length(&rb) == 7, "rbu8 peek leaves data in place");
+	
+	rb_check(rbu8_read_and_consume(&rb, read, 12) == 7 && rb_check_sequence(read, 4, 7), "rbu8 consume across the wrap");
+	rb_check(rbu8_length(&rb) == 0 && rb.tail == rb.head, "rbu8 empty after consuming everything");
+	
+	//Writing more than fits keeps only the newest 7, still split in two
+	rbu8_write(&rb, data, 12);
+	rb_check(rbu8_length(&rb) == 7, "rbu8 overwrite length");
+	rb_check(rbu8_read_and_consume(&rb, read, 7) == 7 && rb_check_sequence(read, 5, 7), "rbu8 overwrite keeps the newest bytes");
+	
+	//Overwriting part of what's stored moves tail past the lost bytes
+	rbu8_write(&rb, data, 6);
+	rbu8_write(&rb, &data[6], 3);
+	rb_check(rbu8_length(&rb) == 7, "rbu8 partial overwrite length");
+	rb_check(rbu8_read_and_consume(&rb, read, 7) == 7 && rb_check_sequence(read, 2, 7), "rbu8 partial overwrite drops the oldest");
+}
+
+static void test_ring_buffer_spsc_copies(void)
+//rbspsc_put/get and rbspsc_write/read across the end of the backing array, and refusal when full
+{
+	uint8_t backing_array[8]; //Holds 7
+	uint8_t data[12], read[12];
+	uint8_t byte = 0;
+	RingBufferSPSC_t rb;
+	for (uint8_t i = 0; i < sizeof(data); i++)
+		data[i] = i;
+	
+	rb_check(rbspsc_init(&rb, backing_array, RBSPSC_MAX_ARRAY_LENGTH + 1) == 1, "spsc init refuses a long array");
+	rb_check(rbspsc_free_space(&rb) == 0 && rbspsc_put(&rb, 0xAA) == 1 && rbspsc_write(&rb, data, 2) == 0, "spsc refused array holds nothing");
+	
+	rb_check(rbspsc_init(&rb, backing_array, sizeof(backing_array)) == 0, "spsc init");
+	rb_check(rbspsc_get(&rb, &byte) == 1 && byte == 0, "spsc get from empty");
+	rb_check(rbspsc_write(&rb, data, 6) == 6 && rbspsc_free_space(&rb) == 1, "spsc write before wrap");
+	rb_check(rbspsc_read(&rb, read, 5) == 5 && rb_check_sequence(read, 0, 5), "spsc read before wrap");
+	
+	//tail = 5, head = 6: 6 and 7 fit before the end, 8..11 go at the start, and the buffer is then full
+	rb_check(rbspsc_write(&rb, &data[6], 6) == 6, "spsc two segment write");
+	rb_check(rb.head == 4 && rbspsc_length(&rb) == 7 && rbspsc_free_space(&rb) == 0, "spsc two segment write indices");
+	rb_check(backing_array[7] == 7 && backing_array[0] == 8 && backing_array[3] == 11, "spsc two segment write data");
+	rb_check(rbspsc_write(&rb, data, 2) == 0 && rbspsc_put(&rb, 0xAA) == 1, "spsc writes refused when full");
+	
+	rb_check(rbspsc_get(&rb, &byte) == 0 && byte == 5, "spsc get oldest byte");
+	rb_check(rbspsc_write(&rb, &data[10], 2) == 1 && rb.head == 5, "spsc write cut short to the space freed");
+	rb_check(rbspsc_read(&rb, read, 12) == 7 && rb_check_sequence(read, 6, 5) && read[5] == 11 && read[6] == 10, "spsc read across the wrap");
+	rb_check(rbspsc_length(&rb) == 0 && rbspsc_free_space(&rb) == 7, "spsc empty after reading everything");
+}
+
+static void test_ring_buffer_spsc_zero_copy(void)
+//rbspsc_reserve/commit and rbspsc_peek_region/release, which hand out one contiguous piece at a time
+{
+	uint8_t backing_array[8]; //Holds 7
+	uint8_t data[8], read[8];
+	uint16_t length;
+	RingBufferSPSC_t rb;
+	for (uint8_t i = 0; i < sizeof(data); i++)
+		data[i] = i;
+	
+	rbspsc_init(&rb, backing_array, sizeof(backing_array));
+	uint8_t* space = rbspsc_reserve(&rb, &length);
+	rb_check(space == &backing_array[0] && length == 7, "spsc reserve when empty leaves the last slot open");
+	rbspsc_write(&rb, data, 6);
+	rbspsc_read(&rb, read, 5);
+	
+	//tail = 5, head = 6: the first reservation stops at the end of the array, the second at the slot before tail
+	space = rbspsc_reserve(&rb, &length);
+	rb_check(space == &backing_array[6] && length == 2, "spsc reserve up to the end of the array");
+	space[0] = 6;
+	space[1] = 7;
+	rb_check(rbspsc_length(&rb) == 1, "spsc reserved bytes hidden until commit");
+	rbspsc_commit(&rb, 2);
+	rb_check(rb.head == 0 && rbspsc_length(&rb) == 3, "spsc commit wraps head");
+	
+	space = rbspsc_reserve(&rb, &length);
+	rb_check(space == &backing_array[0] && length == 4, "spsc reserve after the wrap stops before tail");
+	memcpy(space, &data[0], 3);
+	rbspsc_commit(&rb, 3); //Committing less than was reserved is fine
+	rb_check(rbspsc_length(&rb) == 6 && rbspsc_free_space(&rb) == 1, "spsc partial commit");
+	
+	const uint8_t* region = rbspsc_peek_region(&rb, &length);
+	rb_check(region == &backing_array[5] && length == 3 && rb_check_sequence(region, 5, 3), "spsc peek region up to the end of the array");
+	rbspsc_release(&rb, 2);
+	region = rbspsc_peek_region(&rb, &length);
+	rb_check(region == &backing_array[7] && length == 1 && region[0] == 7, "spsc peek region after a partial release");
+	rbspsc_release(&rb, 1);
+	region = rbspsc_peek_region(&rb, &length);
+	rb_check(region == &backing_array[0] && length == 3 && rb_check_sequence(region, 0, 3), "spsc peek region after the wrap");
+	rbspsc_release(&rb, 3);
+	rbspsc_peek_region(&rb, &length);
+	rb_check(length == 0 && rbspsc_length(&rb) == 0, "spsc empty after releasing everything");
+}
+
+void test_ring_buffer_spsc(void)
+{
+	rb_test_failures = 0;
+	test_ring_buffer_spsc_copies();
+	test_ring_buffer_spsc_zero_copy();
+	printf("test_ring_buffer_spsc: %s\n", rb_test_failures ? "FAIL" : "PASS");
+}
+
+static void test_ring_bufferu8_zero_copy(void)
+//rbu8_reserve/commit and rbu8_peek_region/release across the end of the backing array
+{
+	uint8_t backing_array[8]; //Holds 7
+	uint8_t data[8], read[8];
+	uint16_t length;
+	RingBufferu8_t rb;
+	for (uint8_t i = 0; i < sizeof(data); i++)
+		data[i] = i;
+	
+	rbu8_init(&rb, backing_array, sizeof(backing_array));
+	rbu8_write(&rb, data, 6);
+	rbu8_read_and_consume(&rb, read, 5);
+	
+	uint8_t* space = rbu8_reserve(&rb, &length);
+	rb_check(space == &backing_array[6] && length == 2, "rbu8 reserve up to the end of the array");
+	memcpy(space, &data[6], 2);
+	rbu8_commit(&rb, 2);
+	space = rbu8_reserve(&rb, &length);
+	rb_check(rb.head == 0 && space == &backing_array[0] && length == 4, "rbu8 reserve after the wrap stops before tail");
+	memcpy(space, data, 4);
+	rbu8_commit(&rb, 4);
+	rb_check(rbu8_length(&rb) == 7, "rbu8 commit fills the buffer");
+	rbu8_reserve(&rb, &length);
+	rb_check(length == 0, "rbu8 reserve when full");
+	
+	const uint8_t* region = rbu8_peek_region(&rb, &length);
+	rb_check(region == &backing_array[5] && length == 3 && rb_check_sequence(region, 5, 3), "rbu8 peek region up to the end of the array");
+	rbu8_release(&rb, length);
+	region = rbu8_peek_region(&rb, &length);
+	rb_check(region == &backing_array[0] && length == 4 && rb_check_sequence(region, 0, 4), "rbu8 peek region after the wrap");
+	rbu8_release(&rb, length);
+	rb_check(rbu8_length(&rb) == 0, "rbu8 empty after releasing everything");
+}
+
+void test_ring_buffer_broadcast(void)
+//A reader that falls behind holds the writer up, and skipping it forward lets the writer carry on
+{
+	uint8_t backing_array[8]; //Holds 7
+	uint8_t data[8], read[8];
+	RingBufferBroadcast_t rb;
+	for (uint8_t i = 0; i < sizeof(data); i++)
+		data[i] = i;
+	
+	rb_test_failures = 0;
+	rbbc_init(&rb, backing_array, sizeof(backing_array));
+	uint8_t fast = rbbc_add_reader(&rb);
+	uint8_t slow = rbbc_add_reader(&rb);
+	rb_check(fast == 0 && slow == 1 && rbbc_free_space(&rb) == 7, "broadcast readers added");
+	
+	rb_check(rbbc_write(&rb, data, 5) == 0, "broadcast write");
+	rb_check(rbbc_read(&rb, fast, read, 8) == 5 && rb_check_sequence(read, 0, 5), "broadcast fast reader");
+	rb_check(rbbc_length(&rb, slow) == 5 && rbbc_free_space(&rb) == 2, "broadcast slow reader still holds its data");
+	
+	//The fast reader has room for 7 more, but the slow one only leaves 2
+	rb_check(rbbc_lagging_readers(&rb, 3) == (1 << slow), "broadcast slow reader reported as lagging");
+	rb_check(rbbc_lagging_readers(&rb, 2) == 0, "broadcast nobody lagging for a write that fits");
+	rb_check(rbbc_write(&rb, data, 3) == 1 && rbbc_length(&rb, fast) == 0 && rbbc_length(&rb, slow) == 5, "broadcast write refused whole");
+	
+	rb_check(rbbc_read(&rb, slow, read, 2) == 2 && rb_check_sequence(read, 0, 2), "broadcast slow reader catches up a little");
+	rb_check(rbbc_write(&rb, &data[5], 3) == 0, "broadcast write across the wrap once there's room");
+	rb_check(rbbc_read(&rb, fast, read, 8) == 3 && rb_check_sequence(read, 5, 3), "broadcast fast reader across the wrap");
+	rb_check(rbbc_read(&rb, slow, read, 8) == 6 && rb_check_sequence(read, 2, 6), "broadcast slow reader across the wrap");
+	
+	rbbc_write(&rb, data, 7);
+	rbbc_skip(&rb, slow, 4);
+	rb_check(rbbc_lagging_readers(&rb, 4) == (1 << fast) && rbbc_free_space(&rb) == 0, "broadcast skip moves the hold up to the other reader");
+	printf("test_ring_buffer_broadcast: %s\n", rb_test_failures ? "FAIL" : "PASS");
+}
+
 void test_ring_bufferu8(void)
 {
+	rb_test_failures = 0;
+	test_ring_bufferu8_wraparound();
+	test_ring_bufferu8_zero_copy();
+	printf("test_ring_bufferu8: %s\n", rb_test_failures ? "FAIL" : "PASS");
+	
 	uint8_t backing_array[10];
 	RingBufferu8_t rb;
 	rbu8_init(&rb, backing_array, 10);
@@ -406,8 +1251,58 @@ void test_ring_bufferu8(void)
 	while (1);
 }
 
+static void test_ring_buffer32agg(void)
+/*	Checks the windowed statistics against a plain pass over the last values pushed, after every push
+	The values start with the extremes so both get evicted, then wander around pressure-sized numbers
+*/
+{
+	const uint8_t window = 5;
+	int32_t backing_array[6];
+	uint16_t min_queue[6], max_queue[6];
+	int32_t pushed[40];
+	RingBuffer32Agg_t agg;
+	uint32_t random = 12345;
+	
+	rb32agg_init(&agg, backing_array, min_queue, max_queue, window + 1);
+	for (uint8_t n = 0; n < sizeof(pushed) / sizeof(pushed[0]); n++)
+	{
+		random = random * 1103515245 + 12345;
+		if (n == 0)
+			pushed[n] = 101325 - 5000; //Lowest value, evicted on the sixth push
+		else if (n == 1)
+			pushed[n] = 101325 + 5000; //Highest value, evicted on the seventh
+		else
+			pushed[n] = 101325 + (int32_t)((random >> 16) % 2001) - 1000;
+		rb32agg_push(&agg, pushed[n]);
+		
+		uint8_t count = min(n + 1, window);
+		int32_t low = pushed[n], high = pushed[n];
+		int64_t sum = 0, sum_squares = 0;
+		for (uint8_t i = n + 1 - count; i <= n; i++)
+		{
+			low = min(low, pushed[i]);
+			high = max(high, pushed[i]);
+			sum += pushed[i];
+			sum_squares += (int64_t)pushed[i] * pushed[i];
+		}
+		int64_t variance = (sum_squares * count - sum * sum) / ((int64_t)count * count);
+		int64_t mean_error = (int64_t)rb32agg_mean(&agg) * count - sum;
+		
+		rb_check(rb32agg_length(&agg) == count, "rb32agg length");
+		rb_check(rb32agg_min(&agg) == low, "rb32agg min");
+		rb_check(rb32agg_max(&agg) == high, "rb32agg max");
+		rb_check(rb32agg_sum(&agg) == sum, "rb32agg sum");
+		rb_check(mean_error > -count && mean_error < count, "rb32agg mean");
+		rb_check(rb32agg_variance(&agg) == variance, "rb32agg variance");
+	}
+}
+
 void test_ring_buffer32(void)
 {
+	rb_test_failures = 0;
+	test_ring_buffer32agg();
+	printf("test_ring_buffer32: %s\n", rb_test_failures ? "FAIL" : "PASS");
+	
 	int32_t barray[11];
 	RingBuffer32_t rb;
 	rb32_init(&rb, barray, 11);
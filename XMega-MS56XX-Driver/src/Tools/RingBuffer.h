@@ -10,6 +10,7 @@
 #define RINGBUFFER_H_
 
 #include <inttypes.h>
+#include "config/conf_ringbuffer.h"
 
 
 // These are circular buffers.
@@ -17,6 +18,26 @@
 //If head == tail + 1 (or (tail = array_length - 1 and head == 0)), there is one character in the buffer, located at tail
 
 
+//--------Statistics, only kept if RINGBUFFER_STATS is defined in conf_ringbuffer.h--------
+typedef struct RingBufferStats
+{
+	//Written by the side that adds data (the producer, for RingBufferSPSC_t)
+	uint16_t high_water; //Most bytes ever stored at once
+	uint32_t overrun_count; //Bytes lost because the buffer was full. Overwritten for RingBufferu8_t, refused for RingBufferSPSC_t
+	uint32_t bytes_in; //Total bytes ever added
+	uint32_t span_start[RINGBUFFER_STATS_SPANS]; //bytes_in when each of the newest writes began
+	uint32_t span_time[RINGBUFFER_STATS_SPANS]; //RINGBUFFER_STATS_TIME() of the same writes, if it is set
+	volatile uint8_t span_head; //Slot the next write's span goes in
+	//Written by the side that removes data (the consumer)
+	volatile uint8_t span_tail; //Span the oldest stored byte belongs to
+	uint32_t tail_position; //Count of the oldest stored byte in bytes_in terms: bytes read plus bytes overwritten
+	uint32_t bytes_out; //Total bytes ever removed by a reader (not counting overwritten ones)
+	uint32_t max_age; //Longest any byte has waited at the tail before being read. Exact while the writes it waited behind fit in the span slots
+} RingBufferStats_t;
+
+void rb_stats_reset(RingBufferStats_t* stats);
+
+
 //--------For unsigned 8 bit integers--------
 typedef struct RingBufferu8
 {
@@ -24,6 +45,9 @@ typedef struct RingBufferu8
 	uint16_t head; // address of the newest item in the array
 	uint16_t tail; // address of the oldest item added
 	uint8_t* buffer;
+#ifdef RINGBUFFER_STATS
+	RingBufferStats_t stats;
+#endif
 } RingBufferu8_t;
 
 void rbu8_print(RingBufferu8_t* buffer, const char* data);
@@ -35,6 +59,10 @@ void rbu8_write(RingBufferu8_t* buffer, const uint8_t* data, uint16_t length);
 
 uint8_t rbu8_read(RingBufferu8_t* buffer, uint8_t* dest, uint16_t length);
 
+uint16_t rbu8_peek(RingBufferu8_t* buffer, uint8_t* dest, uint16_t offset, uint16_t length);
+
+uint16_t rbu8_read_and_consume(RingBufferu8_t* buffer, uint8_t* dest, uint16_t length);
+
 uint16_t rbu8_length(RingBufferu8_t* buffer);
 
 void rbu8_delete_oldest(RingBufferu8_t* buffer, uint16_t length);
@@ -43,6 +71,16 @@ void rbu8_init(RingBufferu8_t* buffer, uint8_t* backing_array, uint16_t backing_
 
 uint8_t rbu8_get_nth(RingBufferu8_t* buffer, uint16_t index);
 
+//Zero-copy access. Write straight into the backing array, then commit what was written
+uint8_t* rbu8_reserve(RingBufferu8_t* buffer, uint16_t* length);
+
+void rbu8_commit(RingBufferu8_t* buffer, uint16_t length);
+
+//Zero-copy access. Use the oldest data straight out of the backing array, then release it
+const uint8_t* rbu8_peek_region(RingBufferu8_t* buffer, uint16_t* length);
+
+void rbu8_release(RingBufferu8_t* buffer, uint16_t length);
+
 
 //-------For 16 bit signed integers------------
 typedef struct RingBuffer16
@@ -86,9 +124,118 @@ void rb32_init(RingBuffer32_t* buffer, int32_t* backing_array, uint16_t backing_
 
 int32_t rb32_get_nth(RingBuffer32_t* buffer, uint16_t index);
 
+//-------Windowed statistics over a RingBuffer32_t------------
+//Keeps the sum, sum of squares, min and max of the last (backing_array_length - 1) values up to date as they are pushed,
+//so none of them need a pass over the window. Min and max use monotonic queues of positions in the window.
+typedef struct RingBuffer32Agg
+{
+	RingBuffer32_t window;
+	int32_t offset; //First value pushed. Sums are of (value - offset), which keeps them small for slow-moving data like pressure
+	int64_t sum;
+	int64_t sum_squares;
+	uint16_t* min_queue; //Positions in window.buffer whose values increase from front to back. Front is the minimum
+	uint16_t* max_queue; //Same, but decreasing. Front is the maximum
+	uint16_t min_front;
+	uint16_t min_count;
+	uint16_t max_front;
+	uint16_t max_count;
+} RingBuffer32Agg_t;
+
+void rb32agg_init(RingBuffer32Agg_t* agg, int32_t* backing_array, uint16_t* min_queue_array, uint16_t* max_queue_array, uint16_t backing_array_length);
+
+void rb32agg_push(RingBuffer32Agg_t* agg, int32_t value);
+
+uint16_t rb32agg_length(RingBuffer32Agg_t* agg);
+
+int64_t rb32agg_sum(RingBuffer32Agg_t* agg);
+
+int32_t rb32agg_mean(RingBuffer32Agg_t* agg);
+
+int64_t rb32agg_variance(RingBuffer32Agg_t* agg);
+
+int32_t rb32agg_min(RingBuffer32Agg_t* agg);
+
+int32_t rb32agg_max(RingBuffer32Agg_t* agg);
+
+//-------Single producer/single consumer, for handing bytes between an ISR and the main loop------------
+//The producer only ever writes head and the consumer only ever writes tail, so no critical sections are needed.
+//Unlike RingBufferu8_t this never overwrites old data; writes that don't fit are cut short instead.
+#define RBSPSC_MAX_ARRAY_LENGTH		256 //Longer backing arrays would let the other side read an index half updated
+typedef struct RingBufferSPSC
+{
+	uint16_t array_length; //Length of the array backing the buffer, not length of data stored in the buffer
+	volatile uint16_t head; // address the next item will be written to. Only changed by the producer
+	volatile uint16_t tail; // address of the oldest item added. Only changed by the consumer
+	uint8_t* buffer;
+#ifdef RINGBUFFER_STATS
+	RingBufferStats_t stats; //Each side only writes its own fields. Read it with rbspsc_get_stats, not directly
+#endif
+} RingBufferSPSC_t;
+
+uint8_t rbspsc_init(RingBufferSPSC_t* buffer, uint8_t* backing_array, uint16_t backing_array_length);
+
+//Producer side
+uint8_t rbspsc_put(RingBufferSPSC_t* buffer, uint8_t data);
+
+uint16_t rbspsc_write(RingBufferSPSC_t* buffer, const uint8_t* data, uint16_t length);
+
+uint16_t rbspsc_free_space(RingBufferSPSC_t* buffer);
+
+uint8_t* rbspsc_reserve(RingBufferSPSC_t* buffer, uint16_t* length);
+
+void rbspsc_commit(RingBufferSPSC_t* buffer, uint16_t length);
+
+//Consumer side
+uint8_t rbspsc_get(RingBufferSPSC_t* buffer, uint8_t* dest);
+
+uint16_t rbspsc_read(RingBufferSPSC_t* buffer, uint8_t* dest, uint16_t length);
+
+uint16_t rbspsc_length(RingBufferSPSC_t* buffer);
+
+const uint8_t* rbspsc_peek_region(RingBufferSPSC_t* buffer, uint16_t* length);
+
+void rbspsc_release(RingBufferSPSC_t* buffer, uint16_t length);
+
+#ifdef RINGBUFFER_STATS
+//Either side
+void rbspsc_get_stats(RingBufferSPSC_t* buffer, RingBufferStats_t* stats);
+#endif
+
+//-------One writer, several readers that each consume at their own pace------------
+//Every reader has its own tail. The writer never overwrites data that any reader still needs;
+//writes that don't fit are refused whole, and rbbc_lagging_readers says who is holding things up.
+#define RB_BROADCAST_NO_READER	0xFF
+
+typedef struct RingBufferBroadcast
+{
+	uint16_t array_length; //Length of the array backing the buffer, not length of data stored in the buffer
+	uint16_t head; // address the next item will be written to
+	uint16_t tails[RB_BROADCAST_MAX_READERS]; // address of the oldest item each reader hasn't read yet
+	uint8_t reader_count;
+	uint8_t* buffer;
+} RingBufferBroadcast_t;
+
+void rbbc_init(RingBufferBroadcast_t* buffer, uint8_t* backing_array, uint16_t backing_array_length);
+
+uint8_t rbbc_add_reader(RingBufferBroadcast_t* buffer);
+
+uint8_t rbbc_write(RingBufferBroadcast_t* buffer, const uint8_t* data, uint16_t length);
+
+uint16_t rbbc_free_space(RingBufferBroadcast_t* buffer);
+
+uint8_t rbbc_lagging_readers(RingBufferBroadcast_t* buffer, uint16_t length);
+
+uint16_t rbbc_length(RingBufferBroadcast_t* buffer, uint8_t reader);
+
+uint16_t rbbc_read(RingBufferBroadcast_t* buffer, uint8_t reader, uint8_t* dest, uint16_t length);
+
+void rbbc_skip(RingBufferBroadcast_t* buffer, uint8_t reader, uint16_t length);
+
 //-------For testing/debugging-----------
 #ifdef DEBUG
 void test_ring_bufferu8(void);
+void test_ring_buffer_spsc(void);
+void test_ring_buffer_broadcast(void);
 void test_ring_buffer32(void);
 #endif
 
@@ -0,0 +1,257 @@
+/*
+ * TaskScheduler.c
+ *
+ * Earliest deadline first cooperative scheduling. See TaskScheduler.h
+ */
+#include "tools/TaskScheduler.h"
+
+#ifdef DEBUG
+#include <stdio.h>
+#endif
+
+static void reset_task_stats(Task_t* task)
+{
+	task->runs = 0;
+	task->overruns = 0;
+	task->max_runtime_us = 0;
+	task->total_runtime_us = 0;
+	task->max_lateness_us = 0;
+}
+
+void task_scheduler_init(TaskScheduler_t* scheduler, uint32_t (*clock_us)(void))
+//clock_us - microseconds from any starting point, e.g. timebase_us
+{
+	scheduler->task_count = 0;
+	scheduler->clock_us = clock_us;
+}
+
+uint8_t task_scheduler_add(TaskScheduler_t* scheduler, const char* name, TaskFunction_t function, void* context, uint32_t period_us)
+/*	Registers function, to be called with context, and returns its task number
+	period_us - time between releases. A periodic task's first release is now
+				0 makes a one-shot task, which waits for task_scheduler_schedule
+	Returns TASK_NONE if TASK_MAX_TASKS tasks already exist
+*/
+{
+	if (scheduler->task_count >= TASK_MAX_TASKS)
+		return TASK_NONE;
+	Task_t* task = &scheduler->tasks[scheduler->task_count];
+	task->name = name;
+	task->function = function;
+	task->context = context;
+	task->period_us = period_us;
+	task->due_us = scheduler->clock_us();
+	task->pending = period_us != 0;
+	reset_task_stats(task);
+	return scheduler->task_count++;
+}
+
+void task_scheduler_schedule(TaskScheduler_t* scheduler, uint8_t task, uint32_t delay_us)
+/*	Releases task delay_us from now, replacing its next release if it already had one
+	For a periodic task this also moves its phase
+*/
+{
+	scheduler->tasks[task].due_us = scheduler->clock_us() + delay_us;
+	scheduler->tasks[task].pending = 1;
+}
+
+void task_scheduler_cancel(TaskScheduler_t* scheduler, uint8_t task)
+//Task won't run again until task_scheduler_schedule
+{
+	scheduler->tasks[task].pending = 0;
+}
+
+uint8_t task_scheduler_run(TaskScheduler_t* scheduler)
+/*	Runs the due task with the earliest deadline, if there is one
+	Return values
+	* 1 - a task ran. Call again straight away, something else may be due
+	* 0 - nothing due. task_scheduler_idle_us says how long until something is
+*/
+{
+	uint32_t now = scheduler->clock_us();
+	Task_t* next = 0;
+	for (uint8_t i = 0; i < scheduler->task_count; i++)
+	{
+		Task_t* task = &scheduler->tasks[i];
+		if (task->pending && (int32_t)(now - task->due_us) >= 0 && (!next || (int32_t)(task->due_us - next->due_us) < 0))
+			next = task;
+	}
+	if (!next)
+		return 0;
+	
+	uint32_t lateness = now - next->due_us;
+	if (lateness > next->max_lateness_us)
+		next->max_lateness_us = lateness;
+	if (next->period_us)
+	{
+		if (lateness >= next->period_us)
+		{
+			//Missed whole releases. Skip them, staying in phase
+			uint32_t missed = lateness / next->period_us;
+			next->overruns += missed;
+			next->due_us += missed * next->period_us;
+		}
+		next->due_us += next->period_us;
+	}
+	else
+	{
+		next->pending = 0; //Before running, so the task can schedule itself again
+	}
+	
+	next->function(next->context);
+	
+	uint32_t runtime = scheduler->clock_us() - now;
+	next->runs++;
+	next->total_runtime_us += runtime;
+	if (runtime > next->max_runtime_us)
+		next->max_runtime_us = runtime;
+	return 1;
+}
+
+uint32_t task_scheduler_idle_us(TaskScheduler_t* scheduler)
+//Time until the next release. 0 if something is already due, UINT32_MAX if nothing is pending
+{
+	uint32_t now = scheduler->clock_us();
+	uint32_t idle = UINT32_MAX;
+	for (uint8_t i = 0; i < scheduler->task_count; i++)
+	{
+		Task_t* task = &scheduler->tasks[i];
+		if (!task->pending)
+			continue;
+		int32_t until = (int32_t)(task->due_us - now);
+		if (until <= 0)
+			return 0;
+		if ((uint32_t)until < idle)
+			idle = until;
+	}
+	return idle;
+}
+
+void task_scheduler_reset_stats(TaskScheduler_t* scheduler)
+{
+	for (uint8_t i = 0; i < scheduler->task_count; i++)
+	{
+		reset_task_stats(&scheduler->tasks[i]);
+	}
+}
+
+
+//----------------Test functions------------------------
+
+#ifdef DEBUG
+
+static uint8_t task_test_failures;
+static uint32_t task_test_now; //The test's clock, moved by hand
+static uint8_t task_test_order[4]; //Which tasks ran, in order
+static uint8_t task_test_ran;
+static TaskScheduler_t task_test_scheduler;
+
+static void task_check(uint8_t passed, const char* what)
+{
+	if (!passed)
+	{
+		printf("FAIL: %s\n", what);
+		task_test_failures++;
+	}
+}
+
+static uint32_t task_test_clock(void)
+{
+	return task_test_now;
+}
+
+static void task_test_record(void* context)
+//Notes which task ran. context is its task number
+{
+	if (task_test_ran < sizeof(task_test_order))
+		task_test_order[task_test_ran] = (uint8_t)(uintptr_t)context;
+	task_test_ran++;
+}
+
+static void task_test_again(void* context)
+//One-shot task that schedules itself 30 us on from inside its own run, and takes 5 us doing it
+{
+	task_test_record(context);
+	task_scheduler_schedule(&task_test_scheduler, (uint8_t)(uintptr_t)context, 30);
+	task_test_now += 5;
+}
+
+static uint8_t task_test_run_all(void)
+//Runs whatever is due, returning how many ran
+{
+	uint8_t runs = 0;
+	task_test_ran = 0;
+	while (task_scheduler_run(&task_test_scheduler))
+		runs++;
+	return runs;
+}
+
+uint8_t test_task_scheduler(void)
+/*	Checks the EDF order (ties to the first registered), one-shot tasks rescheduling themselves, overrun skipping keeping
+	the phase, and the clock wrapping. Uses its own clock, so it can run anywhere, including on the host
+	Returns 0 if everything passed, 1 if anything failed
+*/
+{
+	TaskScheduler_t* scheduler = &task_test_scheduler;
+	task_test_failures = 0;
+	
+	//Earliest deadline first, ties to the first registered, whatever order they were scheduled in
+	task_test_now = 1000;
+	task_scheduler_init(scheduler, task_test_clock);
+	uint8_t a = task_scheduler_add(scheduler, "a", task_test_record, (void*)0, 0);
+	uint8_t b = task_scheduler_add(scheduler, "b", task_test_record, (void*)1, 0);
+	uint8_t c = task_scheduler_add(scheduler, "c", task_test_record, (void*)2, 0);
+	task_check(task_scheduler_run(scheduler) == 0, "one-shot tasks wait to be scheduled");
+	task_scheduler_schedule(scheduler, b, 100);
+	task_scheduler_schedule(scheduler, a, 100);
+	task_scheduler_schedule(scheduler, c, 50);
+	task_check(task_scheduler_idle_us(scheduler) == 50, "idle until the earliest");
+	task_test_now = 1099;
+	task_check(task_test_run_all() == 1 && task_test_order[0] == c, "only the due task runs");
+	task_test_now = 1200;
+	task_check(task_test_run_all() == 2 && task_test_order[0] == a && task_test_order[1] == b, "tie goes to the first registered");
+	task_check(task_scheduler_idle_us(scheduler) == UINT32_MAX, "nothing pending after one-shots ran");
+	
+	//A one-shot task rescheduling itself from inside its run is released again, from when it called
+	task_test_now = 2000;
+	task_scheduler_init(scheduler, task_test_clock);
+	uint8_t again = task_scheduler_add(scheduler, "again", task_test_again, (void*)0, 0);
+	task_scheduler_schedule(scheduler, again, 0);
+	task_check(task_test_run_all() == 1, "rescheduled task isn't due straight away");
+	task_check(scheduler->tasks[again].pending && task_scheduler_idle_us(scheduler) == 25, "rescheduled from inside its run");
+	task_test_now = 2030;
+	task_check(task_test_run_all() == 1 && scheduler->tasks[again].runs == 2, "runs again when its new release comes");
+	task_check(scheduler->tasks[again].max_runtime_us == 5, "runtime includes the rescheduling run");
+	
+	//Overruns: missed releases are skipped and counted, and the next release stays on the original phase
+	task_test_now = 3000;
+	task_scheduler_init(scheduler, task_test_clock);
+	uint8_t periodic = task_scheduler_add(scheduler, "periodic", task_test_record, (void*)0, 100);
+	task_check(task_test_run_all() == 1 && scheduler->tasks[periodic].due_us == 3100, "periodic task runs at once");
+	task_test_now = 3350;
+	task_check(task_test_run_all() == 1, "late periodic task runs once, not back to back");
+	task_check(scheduler->tasks[periodic].overruns == 2, "missed releases counted");
+	task_check(scheduler->tasks[periodic].due_us == 3400, "next release keeps the phase");
+	task_check(scheduler->tasks[periodic].max_lateness_us == 250, "lateness from the missed release");
+	task_test_now = 3399;
+	task_check(task_test_run_all() == 0 && task_scheduler_idle_us(scheduler) == 1, "not due before its phase");
+	
+	//The clock wrapping: idle times, due tasks and deadline order across it
+	task_test_now = 0xFFFFFF00;
+	task_scheduler_init(scheduler, task_test_clock);
+	a = task_scheduler_add(scheduler, "a", task_test_record, (void*)0, 0);
+	b = task_scheduler_add(scheduler, "b", task_test_record, (void*)1, 0);
+	task_scheduler_schedule(scheduler, b, 0x110); //Due at 0x10, after the wrap
+	task_scheduler_schedule(scheduler, a, 0xF0); //Due at 0xFFFFFFF0, before it
+	task_check(task_scheduler_idle_us(scheduler) == 0xF0, "idle before the wrap");
+	task_test_now = 0xFFFFFFF8;
+	task_check(task_test_run_all() == 1 && task_test_order[0] == a, "due before the wrap");
+	task_check(task_scheduler_idle_us(scheduler) == 0x18, "idle across the wrap");
+	task_scheduler_schedule(scheduler, a, 0x04); //Due at 0xFFFFFFFC, before the wrap and so before b
+	task_test_now = 0x20;
+	task_check(task_test_run_all() == 2 && task_test_order[0] == a && task_test_order[1] == b, "deadline order across the wrap");
+	
+	printf("test_task_scheduler: %s\n", task_test_failures ? "FAIL" : "PASS");
+	return task_test_failures != 0;
+}
+
+#endif
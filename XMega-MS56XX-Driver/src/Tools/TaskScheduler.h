@@ -0,0 +1,64 @@
+/*
+ * TaskScheduler.h
+ *
+ * Cooperative scheduler for the main loop. Tasks are plain functions that run to completion; each call to
+ * task_scheduler_run starts the due task with the earliest deadline (the one registered first on a tie), so a slow task
+ * delays the others instead of being interrupted. Periodic tasks are released every period_us, keeping their phase.
+ * One-shot tasks run once per task_scheduler_schedule.
+ *
+ * Every task's runs, runtime and lateness are kept. A periodic task still waiting when its next release comes has
+ * overrun: the missed releases are counted and skipped rather than run back to back.
+ *
+ * Times come from the clock function given to task_scheduler_init, in microseconds. It may wrap; delays and periods
+ * have to stay under half its range (35 minutes for a 32 bit microsecond clock).
+ * Everything lives in TaskScheduler_t, nothing is allocated. Doesn't depend on anything AVR specific.
+ */
+
+
+#ifndef TASKSCHEDULER_H_
+#define TASKSCHEDULER_H_
+
+#include <inttypes.h>
+
+#define TASK_MAX_TASKS		8
+#define TASK_NONE			0xFF
+
+typedef void (*TaskFunction_t)(void* context);
+
+typedef struct Task
+{
+	const char* name; //For reports
+	TaskFunction_t function;
+	void* context;
+	uint32_t period_us; //0 = one-shot
+	uint32_t due_us;
+	uint8_t pending; //Waiting to run at due_us
+	
+	uint32_t runs;
+	uint32_t overruns; //Releases missed because the task hadn't started by its next one
+	uint32_t max_runtime_us;
+	uint64_t total_runtime_us;
+	uint32_t max_lateness_us; //Longest wait past due_us
+} Task_t;
+
+typedef struct TaskScheduler
+{
+	Task_t tasks[TASK_MAX_TASKS];
+	uint8_t task_count;
+	uint32_t (*clock_us)(void);
+} TaskScheduler_t;
+
+void task_scheduler_init(TaskScheduler_t* scheduler, uint32_t (*clock_us)(void));
+uint8_t task_scheduler_add(TaskScheduler_t* scheduler, const char* name, TaskFunction_t function, void* context, uint32_t period_us);
+void task_scheduler_schedule(TaskScheduler_t* scheduler, uint8_t task, uint32_t delay_us);
+void task_scheduler_cancel(TaskScheduler_t* scheduler, uint8_t task);
+uint8_t task_scheduler_run(TaskScheduler_t* scheduler);
+uint32_t task_scheduler_idle_us(TaskScheduler_t* scheduler);
+void task_scheduler_reset_stats(TaskScheduler_t* scheduler);
+
+//-------For testing/debugging-----------
+#ifdef DEBUG
+uint8_t test_task_scheduler(void);
+#endif
+
+#endif /* TASKSCHEDULER_H_ */
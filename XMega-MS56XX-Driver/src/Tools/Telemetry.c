@@ -0,0 +1,332 @@
+/*
+ * Telemetry.c
+ *
+ * Binary telemetry frames. See Telemetry.h for the frame layout.
+ */
+#include "tools/Telemetry.h"
+#include <string.h>
+#ifdef DEBUG
+#include <stdio.h>
+#endif
+
+
+//--------------Field helpers--------------------
+void telemetry_put_u16(uint8_t* dest, uint16_t value)
+{
+	dest[0] = (uint8_t)value;
+	dest[1] = (uint8_t)(value >> 8);
+}
+
+void telemetry_put_u32(uint8_t* dest, uint32_t value)
+{
+	dest[0] = (uint8_t)value;
+	dest[1] = (uint8_t)(value >> 8);
+	dest[2] = (uint8_t)(value >> 16);
+	dest[3] = (uint8_t)(value >> 24);
+}
+
+uint16_t telemetry_get_u16(const uint8_t* src)
+{
+	return ((uint16_t)src[0]) | (((uint16_t)src[1]) << 8);
+}
+
+uint32_t telemetry_get_u32(const uint8_t* src)
+{
+	return ((uint32_t)src[0]) | (((uint32_t)src[1]) << 8) | (((uint32_t)src[2]) << 16) | (((uint32_t)src[3]) << 24);
+}
+
+//--------------CRC and COBS--------------------
+uint16_t crc16_ccitt_update(uint16_t crc, const uint8_t* data, uint16_t length)
+/*	CRC-16/CCITT-FALSE: polynomial 0x1021, start with crc = 0xFFFF, no reflection, no final XOR
+	Bitwise rather than table driven, to keep 512 bytes of table out of flash
+*/
+{
+	for (uint16_t i = 0; i < length; i++)
+	{
+		crc ^= ((uint16_t)data[i]) << 8;
+		for (uint8_t bit = 0; bit < 8; bit++)
+		{
+			if (crc & 0x8000)
+				crc = (crc << 1) ^ 0x1021;
+			else
+				crc <<= 1;
+		}
+	}
+	return crc;
+}
+
+uint16_t cobs_encode(const uint8_t* src, uint16_t length, uint8_t* dest)
+/*	Consistent Overhead Byte Stuffing. Writes src to dest with every 0x00 removed
+	Each run of non-zero bytes is preceded by a code byte giving the distance to the next zero (or 0xFF for a full run)
+	dest needs room for length + length / 254 + 1 bytes. Doesn't add the 0x00 delimiter
+	Returns the number of bytes written to dest
+*/
+{
+	uint16_t code_index = 0;
+	uint16_t out = 1;
+	uint8_t code = 1;
+	
+	for (uint16_t i = 0; i < length; i++)
+	{
+		if (src[i] == 0)
+		{
+			dest[code_index] = code;
+			code_index = out++;
+			code = 1;
+		}
+		else
+		{
+			dest[out++] = src[i];
+			code++;
+			if (code == 0xFF && i + 1 < length) //Longest run a code byte can describe. At the very end it needs no code byte after it
+			{
+				dest[code_index] = code;
+				code_index = out++;
+				code = 1;
+			}
+		}
+	}
+	dest[code_index] = code;
+	return out;
+}
+
+uint16_t cobs_decode(const uint8_t* src, uint16_t length, uint8_t* dest)
+/*	Undoes cobs_encode. src must not include the 0x00 delimiter
+	Returns the number of bytes written to dest, or 0 if src isn't valid COBS
+*/
+{
+	uint16_t in = 0;
+	uint16_t out = 0;
+	
+	while (in < length)
+	{
+		uint8_t code = src[in++];
+		if (code == 0 || in + code - 1 > length)
+			return 0;
+		for (uint8_t i = 1; i < code; i++)
+		{
+			dest[out++] = src[in++];
+		}
+		if (code != 0xFF && in < length) //A code below 0xFF stands for a zero, except at the very end
+			dest[out++] = 0;
+	}
+	return out;
+}
+
+//--------------Encoding--------------------
+uint8_t telemetry_encode_frame(uint8_t type, uint16_t sequence, const uint8_t* payload, uint8_t length, uint8_t* dest)
+/*	Builds a complete frame, ready to send: COBS encoded and 0x00 terminated
+	dest must be at least TELEMETRY_MAX_FRAME bytes. length must be TELEMETRY_MAX_PAYLOAD or less
+	Returns the number of bytes in dest, or 0 if the payload was too long
+*/
+{
+	uint8_t raw[TELEMETRY_MAX_RAW_FRAME];
+	if (length > TELEMETRY_MAX_PAYLOAD)
+		return 0;
+	
+	raw[0] = type;
+	telemetry_put_u16(&raw[1], sequence);
+	memcpy(&raw[TELEMETRY_HEADER_LENGTH], payload, length);
+	uint8_t raw_length = TELEMETRY_HEADER_LENGTH + length;
+	telemetry_put_u16(&raw[raw_length], crc16_ccitt_update(0xFFFF, raw, raw_length));
+	raw_length += TELEMETRY_CRC_LENGTH;
+	
+	uint8_t frame_length = cobs_encode(raw, raw_length, dest);
+	dest[frame_length++] = 0x00;
+	return frame_length;
+}
+
+uint8_t telemetry_encode_sample(uint16_t sequence, const TelemetrySample_t* sample, uint8_t* dest)
+/*	Builds a TELEMETRY_TYPE_SAMPLE frame. 20 bytes on the wire, against about 60 for the printf line
+	Returns the number of bytes in dest
+*/
+{
+	uint8_t payload[TELEMETRY_SAMPLE_PAYLOAD_LENGTH];
+	telemetry_put_sample(payload, sample);
+	return telemetry_encode_frame(TELEMETRY_TYPE_SAMPLE, sequence, payload, TELEMETRY_SAMPLE_PAYLOAD_LENGTH, dest);
+}
+
+//--------------Decoding--------------------
+void telemetry_decoder_init(TelemetryDecoder_t* decoder)
+{
+	decoder->length = 0;
+	decoder->overflow = 0;
+	decoder->good_frames = 0;
+	decoder->bad_frames = 0;
+}
+
+uint8_t telemetry_decoder_push(TelemetryDecoder_t* decoder, uint8_t byte, TelemetryFrame_t* frame)
+/*	Feed received bytes in one at a time
+	Return values
+	* 0 - no complete frame yet
+	* 1 - byte finished a frame with a good CRC, which is now in frame
+*/
+{
+	if (byte != 0x00)
+	{
+		if (decoder->length < TELEMETRY_MAX_FRAME)
+			decoder->buffer[decoder->length++] = byte;
+		else
+			decoder->overflow = 1;
+		return 0;
+	}
+	
+	//Delimiter: whatever came before it is one frame
+	uint8_t encoded_length = decoder->length;
+	uint8_t overflow = decoder->overflow;
+	decoder->length = 0;
+	decoder->overflow = 0;
+	if (encoded_length == 0) //Back to back delimiters, e.g. when starting mid-stream. Not an error
+		return 0;
+	
+	uint8_t raw[TELEMETRY_MAX_FRAME];
+	uint16_t raw_length = overflow ? 0 : cobs_decode(decoder->buffer, encoded_length, raw);
+	if (raw_length < TELEMETRY_HEADER_LENGTH + TELEMETRY_CRC_LENGTH || raw_length > TELEMETRY_MAX_RAW_FRAME
+		|| crc16_ccitt_update(0xFFFF, raw, raw_length - TELEMETRY_CRC_LENGTH) != telemetry_get_u16(&raw[raw_length - TELEMETRY_CRC_LENGTH]))
+	{
+		decoder->bad_frames++;
+		return 0;
+	}
+	
+	frame->type = raw[0];
+	frame->sequence = telemetry_get_u16(&raw[1]);
+	frame->length = raw_length - TELEMETRY_HEADER_LENGTH - TELEMETRY_CRC_LENGTH;
+	memcpy(frame->payload, &raw[TELEMETRY_HEADER_LENGTH], frame->length);
+	decoder->good_frames++;
+	return 1;
+}
+
+uint8_t telemetry_parse_sample(const TelemetryFrame_t* frame, TelemetrySample_t* sample)
+/*	Unpacks a TELEMETRY_TYPE_SAMPLE frame
+	Return values
+	* 0 - success
+	* 1 - frame isn't a sample frame
+*/
+{
+	if (frame->type != TELEMETRY_TYPE_SAMPLE || frame->length != TELEMETRY_SAMPLE_PAYLOAD_LENGTH)
+		return 1;
+	telemetry_get_sample(frame->payload, sample);
+	return 0;
+}
+
+void telemetry_put_sample(uint8_t* dest, const TelemetrySample_t* sample)
+//Writes the TELEMETRY_SAMPLE_PAYLOAD_LENGTH byte sample layout, also used for flash log records
+{
+	telemetry_put_u32(&dest[0], sample->timestamp);
+	telemetry_put_u32(&dest[4], (uint32_t)sample->pressure);
+	telemetry_put_u32(&dest[8], (uint32_t)sample->temperature);
+	dest[12] = sample->flags;
+}
+
+void telemetry_get_sample(const uint8_t* src, TelemetrySample_t* sample)
+{
+	sample->timestamp = telemetry_get_u32(&src[0]);
+	sample->pressure = (int32_t)telemetry_get_u32(&src[4]);
+	sample->temperature = (int32_t)telemetry_get_u32(&src[8]);
+	sample->flags = src[12];
+}
+
+//----------------Test functions------------------------
+
+#ifdef DEBUG
+
+static uint8_t telemetry_test_failures;
+
+static void telemetry_check(uint8_t passed, const char* what)
+{
+	if (!passed)
+	{
+		printf("FAIL: %s\n", what);
+		telemetry_test_failures++;
+	}
+}
+
+static void telemetry_check_cobs(const uint8_t* raw, uint16_t raw_length, const uint8_t* encoded, uint16_t encoded_length, const char* what)
+//Encodes raw and compares with the expected bytes, then decodes that back to raw
+{
+	uint8_t out[TELEMETRY_MAX_FRAME + 256];
+	uint16_t length = cobs_encode(raw, raw_length, out);
+	telemetry_check(length == encoded_length && memcmp(out, encoded, length) == 0, what);
+	length = cobs_decode(encoded, encoded_length, out);
+	telemetry_check(length == raw_length && memcmp(out, raw, length) == 0, what);
+}
+
+uint8_t test_telemetry(void)
+/*	Known-answer checks for the CRC, COBS and the frame layout, so the firmware and ground station can't drift apart
+	The COBS vectors are the ones from Cheshire and Baker's paper, the CRC is the standard "123456789" check value
+	Returns 0 if everything passed, 1 if anything failed
+*/
+{
+	static const uint8_t crc_check[] = "123456789";
+	static const uint8_t zero[] = {0x00}, zero_encoded[] = {0x01, 0x01};
+	static const uint8_t zeros[] = {0x00, 0x00}, zeros_encoded[] = {0x01, 0x01, 0x01};
+	static const uint8_t inner[] = {0x00, 0x11, 0x00}, inner_encoded[] = {0x01, 0x02, 0x11, 0x01};
+	static const uint8_t middle[] = {0x11, 0x22, 0x00, 0x33}, middle_encoded[] = {0x03, 0x11, 0x22, 0x02, 0x33};
+	static const uint8_t none[] = {0x11, 0x22, 0x33, 0x44}, none_encoded[] = {0x05, 0x11, 0x22, 0x33, 0x44};
+	static const uint8_t trailing[] = {0x11, 0x00, 0x00, 0x00}, trailing_encoded[] = {0x02, 0x11, 0x01, 0x01, 0x01};
+	//Ack for O applied, sequence 0x0102: type, sequence, payload, CRC 0x9225, then COBS and the delimiter
+	static const uint8_t ack_frame[] = {0x05, 0x02, 0x02, 0x01, 0x4F, 0x03, 0x25, 0x92, 0x00};
+	uint8_t raw[256], encoded[258], frame[TELEMETRY_MAX_FRAME];
+	TelemetryFrame_t decoded;
+	TelemetryDecoder_t decoder;
+	
+	telemetry_test_failures = 0;
+	telemetry_check(crc16_ccitt_update(0xFFFF, crc_check, 9) == 0x29B1, "CRC-16/CCITT-FALSE check value");
+	telemetry_check(crc16_ccitt_update(crc16_ccitt_update(0xFFFF, crc_check, 4), &crc_check[4], 5) == 0x29B1, "CRC in two pieces");
+	
+	telemetry_check_cobs(zero, sizeof(zero), zero_encoded, sizeof(zero_encoded), "COBS 00");
+	telemetry_check_cobs(zeros, sizeof(zeros), zeros_encoded, sizeof(zeros_encoded), "COBS 00 00");
+	telemetry_check_cobs(inner, sizeof(inner), inner_encoded, sizeof(inner_encoded), "COBS 00 11 00");
+	telemetry_check_cobs(middle, sizeof(middle), middle_encoded, sizeof(middle_encoded), "COBS 11 22 00 33");
+	telemetry_check_cobs(none, sizeof(none), none_encoded, sizeof(none_encoded), "COBS 11 22 33 44");
+	telemetry_check_cobs(trailing, sizeof(trailing), trailing_encoded, sizeof(trailing_encoded), "COBS 11 00 00 00");
+	
+	//01 .. FE is exactly one full run: FF 01 .. FE, with no code byte after it
+	for (uint16_t i = 0; i < 254; i++)
+		raw[i] = i + 1;
+	encoded[0] = 0xFF;
+	memcpy(&encoded[1], raw, 254);
+	telemetry_check_cobs(raw, 254, encoded, 255, "COBS 01 .. FE");
+	//01 .. FF runs one byte over: FF 01 .. FE 02 FF
+	raw[254] = 0xFF;
+	encoded[255] = 0x02;
+	encoded[256] = 0xFF;
+	telemetry_check_cobs(raw, 255, encoded, 257, "COBS 01 .. FF");
+	//02 .. FF 00: FF 02 .. FF 01 01
+	for (uint16_t i = 0; i < 254; i++)
+		raw[i] = i + 2;
+	raw[254] = 0x00;
+	encoded[0] = 0xFF;
+	memcpy(&encoded[1], raw, 254);
+	encoded[255] = 0x01;
+	encoded[256] = 0x01;
+	telemetry_check_cobs(raw, 255, encoded, 257, "COBS 02 .. FF 00");
+	telemetry_check(cobs_decode(middle_encoded, sizeof(middle_encoded) - 1, raw) == 0, "COBS decode of a cut short run");
+	
+	uint8_t payload[2] = {'O', 0};
+	uint8_t length = telemetry_encode_frame(TELEMETRY_TYPE_ACK, 0x0102, payload, 2, frame);
+	telemetry_check(length == sizeof(ack_frame) && memcmp(frame, ack_frame, length) == 0, "ack frame bytes");
+	
+	//Joining mid-stream: junk up to a delimiter is dropped, then the frame decodes
+	telemetry_decoder_init(&decoder);
+	uint8_t got_frame = 0;
+	telemetry_decoder_push(&decoder, 0x37, &decoded);
+	telemetry_decoder_push(&decoder, 0x00, &decoded);
+	for (uint8_t i = 0; i < length; i++)
+		got_frame |= telemetry_decoder_push(&decoder, frame[i], &decoded);
+	telemetry_check(got_frame && decoded.type == TELEMETRY_TYPE_ACK && decoded.sequence == 0x0102 && decoded.length == 2
+		&& decoded.payload[0] == 'O' && decoded.payload[1] == 0, "decoder after junk");
+	telemetry_check(decoder.good_frames == 1 && decoder.bad_frames == 1, "decoder counts junk as one bad frame");
+	
+	//A flipped bit fails the CRC
+	frame[4] ^= 0x01;
+	got_frame = 0;
+	for (uint8_t i = 0; i < length; i++)
+		got_frame |= telemetry_decoder_push(&decoder, frame[i], &decoded);
+	telemetry_check(!got_frame && decoder.bad_frames == 2, "decoder rejects a corrupted frame");
+	
+	printf("test_telemetry: %s\n", telemetry_test_failures ? "FAIL" : "PASS");
+	return telemetry_test_failures != 0;
+}
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * Telemetry.h
+ *
+ * Binary telemetry frames, for sending samples over the XBee/computer link in far fewer bytes than printf text.
+ *
+ * Frame, before encoding:
+ *	type (1) | sequence (2) | payload (0 - TELEMETRY_MAX_PAYLOAD) | CRC-16 (2)
+ * Multi-byte fields are little endian. The CRC is CRC-16/CCITT-FALSE over everything before it.
+ * The frame is then COBS encoded, which removes every 0x00 byte, and followed by a single 0x00.
+ * So 0x00 is the sync byte: a receiver that joins mid-stream just waits for the next one.
+ *
+ * Doesn't depend on anything AVR specific, so the ground station tools build it too.
+ */
+
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <inttypes.h>
+
+#define TELEMETRY_MAX_PAYLOAD		64
+#define TELEMETRY_HEADER_LENGTH		3 //type + sequence
+#define TELEMETRY_CRC_LENGTH		2
+#define TELEMETRY_MAX_RAW_FRAME		(TELEMETRY_HEADER_LENGTH + TELEMETRY_MAX_PAYLOAD + TELEMETRY_CRC_LENGTH)
+#define TELEMETRY_MAX_FRAME			(TELEMETRY_MAX_RAW_FRAME + 2) //COBS adds one byte per 254, plus the 0x00 delimiter
+
+//Frame types
+#define TELEMETRY_TYPE_SAMPLE		0x01
+#define TELEMETRY_TYPE_ACK			0x02 //Payload: command letter, status (0 = applied, 1 = rejected)
+#define TELEMETRY_TYPE_DELTA		0x03 //Payload: DeltaStream records, starting with a keyframe (tools/DeltaStream.h)
+#define TELEMETRY_TYPE_STATUS		0x04 //Payload: uptime ms (4), receive overruns (4), samples dropped (4), status frames dropped (4), CPU awake % last sample (1), since last status (1), samples started late (4), pressure mean, min, max over the last samples (4 each), transmit bytes lost to DMA errors (4)
+#define TELEMETRY_TYPE_RAW			0x05 //Payload: timestamp (4), D1 (4), D2 (4), flags (1). Uncompensated sensor readings
+#define TELEMETRY_TYPE_CALIBRATION	0x06 //Payload: model (1), C1 - C6 (2 each). What's needed to compensate TELEMETRY_TYPE_RAW
+#define TELEMETRY_TYPE_LOG			0x07 //Payload: position of the first record (4), then samples in the TELEMETRY_TYPE_SAMPLE layout. None = end of log
+#define TELEMETRY_TYPE_PROFILE		0x08 //Payload: region (1), runs (4), min, max cycles (4 each), total cycles (8, low half first), name. DEBUG builds only
+#define TELEMETRY_TYPE_TASK			0x09 //Payload: task (1), runs, overruns, max runtime us (4 each), total runtime us (8, low half first), max lateness us (4), name
+
+//Sample flags
+#define TELEMETRY_FLAG_VALID		0x01
+
+typedef struct TelemetrySample
+{
+	uint32_t timestamp; //Microseconds, middle of the pressure conversion (drivers/Timebase.h). Wraps every 71 minutes
+	int32_t pressure; //Pascals
+	int32_t temperature; //Centi-degrees celsius
+	uint8_t flags; //TELEMETRY_FLAG_*
+} TelemetrySample_t;
+#define TELEMETRY_SAMPLE_PAYLOAD_LENGTH	13
+
+typedef struct TelemetryFrame
+{
+	uint8_t type;
+	uint16_t sequence;
+	uint8_t length; //Of payload
+	uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+} TelemetryFrame_t;
+
+//Receives a byte stream one byte at a time and pulls complete, CRC-checked frames out of it
+typedef struct TelemetryDecoder
+{
+	uint8_t buffer[TELEMETRY_MAX_FRAME];
+	uint8_t length;
+	uint8_t overflow; //1 = current frame was too long, throw it away at the next delimiter
+	uint32_t good_frames;
+	uint32_t bad_frames; //CRC failures, bad COBS and oversized frames
+} TelemetryDecoder_t;
+
+//Building blocks
+uint16_t crc16_ccitt_update(uint16_t crc, const uint8_t* data, uint16_t length);
+uint16_t cobs_encode(const uint8_t* src, uint16_t length, uint8_t* dest);
+uint16_t cobs_decode(const uint8_t* src, uint16_t length, uint8_t* dest);
+
+//Encoding
+uint8_t telemetry_encode_frame(uint8_t type, uint16_t sequence, const uint8_t* payload, uint8_t length, uint8_t* dest);
+uint8_t telemetry_encode_sample(uint16_t sequence, const TelemetrySample_t* sample, uint8_t* dest);
+
+//Decoding
+void telemetry_decoder_init(TelemetryDecoder_t* decoder);
+uint8_t telemetry_decoder_push(TelemetryDecoder_t* decoder, uint8_t byte, TelemetryFrame_t* frame);
+uint8_t telemetry_parse_sample(const TelemetryFrame_t* frame, TelemetrySample_t* sample);
+void telemetry_put_sample(uint8_t* dest, const TelemetrySample_t* sample);
+void telemetry_get_sample(const uint8_t* src, TelemetrySample_t* sample);
+
+//Little endian field helpers, shared with the other stream encoders
+void telemetry_put_u16(uint8_t* dest, uint16_t value);
+void telemetry_put_u32(uint8_t* dest, uint32_t value);
+uint16_t telemetry_get_u16(const uint8_t* src);
+uint32_t telemetry_get_u32(const uint8_t* src);
+
+//-------For testing/debugging-----------
+#ifdef DEBUG
+uint8_t test_telemetry(void);
+#endif
+
+#endif /* TELEMETRY_H_ */
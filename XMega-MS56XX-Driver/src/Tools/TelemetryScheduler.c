@@ -0,0 +1,185 @@
+/*
+ * TelemetryScheduler.c
+ *
+ * Priority and bandwidth based telemetry admission. See TelemetryScheduler.h
+ */
+#include "tools/TelemetryScheduler.h"
+
+#ifdef DEBUG
+#include <stdio.h>
+#endif
+
+
+void telemetry_scheduler_init(TelemetryScheduler_t* scheduler, uint32_t baudrate, uint32_t burst_bytes, uint16_t reserve_bytes, uint32_t now_ms)
+/*	baudrate - of the link, assumed 8N1
+	burst_bytes - most bytes that can be sent back to back. The transmit queue size is a good choice
+	reserve_bytes - headroom kept back per priority level. Around the size of one high priority message
+	The bucket starts full
+*/
+{
+	telemetry_scheduler_set_baudrate(scheduler, baudrate);
+	scheduler->burst_bytes = burst_bytes;
+	scheduler->tokens_milli = burst_bytes * 1000;
+	scheduler->reserve_bytes = reserve_bytes;
+	scheduler->last_refill_ms = now_ms;
+	scheduler->channel_count = 0;
+}
+
+void telemetry_scheduler_set_baudrate(TelemetryScheduler_t* scheduler, uint32_t baudrate)
+//Call whenever the link's baud rate changes
+{
+	scheduler->bytes_per_second = baudrate / 10; //Start + 8 data + stop
+}
+
+uint8_t telemetry_scheduler_add_channel(TelemetryScheduler_t* scheduler, uint8_t priority, uint16_t min_interval_ms, uint8_t periodic)
+/*	Registers a kind of message and returns its channel number, to be passed to telemetry_scheduler_admit
+	periodic - 1 for messages sent over and over (status), which are thinned out when refused
+			   0 for events (acks, reports) that are refused one at a time and never thinned out
+	Returns 0xFF if TELEMETRY_MAX_CHANNELS channels already exist
+*/
+{
+	if (scheduler->channel_count >= TELEMETRY_MAX_CHANNELS)
+		return 0xFF;
+	TelemetryChannel_t* channel = &scheduler->channels[scheduler->channel_count];
+	channel->priority = priority;
+	channel->min_interval_ms = min_interval_ms;
+	channel->periodic = periodic;
+	channel->decimation = 1;
+	channel->decimation_count = 0;
+	channel->fit_streak = 0;
+	channel->last_sent_ms = 0;
+	channel->sent = 0;
+	channel->dropped = 0;
+	return scheduler->channel_count++;
+}
+
+static void telemetry_scheduler_refill(TelemetryScheduler_t* scheduler, uint32_t now_ms)
+{
+	uint32_t elapsed = now_ms - scheduler->last_refill_ms;
+	uint32_t limit = scheduler->burst_bytes * 1000;
+	scheduler->last_refill_ms = now_ms;
+	
+	//elapsed * bytes_per_second can overflow after a long gap, but by then the bucket is full anyway
+	if (elapsed >= limit / (scheduler->bytes_per_second ? scheduler->bytes_per_second : 1))
+		scheduler->tokens_milli = limit;
+	else
+		scheduler->tokens_milli += elapsed * scheduler->bytes_per_second;
+	if (scheduler->tokens_milli > limit)
+		scheduler->tokens_milli = limit;
+}
+
+uint8_t telemetry_scheduler_admit(TelemetryScheduler_t* scheduler, uint8_t channel_number, uint16_t length, uint16_t queue_free, uint32_t now_ms)
+/*	Ask before sending a message of length bytes on a channel
+	queue_free - space left in the transmit queue (e.g. UART_tx_free_space()), so nothing gets cut short there
+	Return values
+	* 1 - send it. Its bytes have been taken out of the budget
+	* 0 - drop it
+*/
+{
+	TelemetryChannel_t* channel = &scheduler->channels[channel_number];
+	telemetry_scheduler_refill(scheduler, now_ms);
+	
+	if (++channel->decimation_count < channel->decimation)
+	{
+		channel->dropped++;
+		return 0;
+	}
+	channel->decimation_count = 0;
+	
+	if (channel->min_interval_ms && channel->sent && now_ms - channel->last_sent_ms < channel->min_interval_ms)
+	{
+		channel->dropped++;
+		return 0;
+	}
+	
+	uint32_t needed_milli = ((uint32_t)length + (uint32_t)channel->priority * scheduler->reserve_bytes) * 1000;
+	if (length > queue_free || needed_milli > scheduler->tokens_milli)
+	{
+		channel->dropped++;
+		channel->fit_streak = 0;
+		if (channel->periodic && channel->decimation < TELEMETRY_MAX_DECIMATION && channel->priority != 0) //Never thin out the most important channel
+			channel->decimation <<= 1;
+		return 0;
+	}
+	
+	scheduler->tokens_milli -= (uint32_t)length * 1000;
+	channel->sent++;
+	channel->last_sent_ms = now_ms;
+	if (channel->decimation > 1 && ++channel->fit_streak >= TELEMETRY_RELAX_AFTER)
+	{
+		channel->decimation >>= 1;
+		channel->fit_streak = 0;
+	}
+	return 1;
+}
+
+
+//----------------Test functions------------------------
+
+#ifdef DEBUG
+
+static uint8_t scheduler_test_failures;
+
+static void scheduler_check(uint8_t passed, const char* what)
+{
+	if (!passed)
+	{
+		printf("FAIL: %s\n", what);
+		scheduler_test_failures++;
+	}
+}
+
+uint8_t test_telemetry_scheduler(void)
+/*	Checks that a refused periodic channel is decimated and recovers, while a refused event channel isn't thinned out,
+	and that the budget is kept back for higher priorities
+	Returns 0 if everything passed, 1 if anything failed
+*/
+{
+	TelemetryScheduler_t scheduler;
+	scheduler_test_failures = 0;
+	
+	//1000 bytes/s, a 200 byte bucket and 50 bytes reserved per priority level
+	telemetry_scheduler_init(&scheduler, 10000, 200, 50, 0);
+	uint8_t samples = telemetry_scheduler_add_channel(&scheduler, 0, 0, 1);
+	uint8_t events = telemetry_scheduler_add_channel(&scheduler, 1, 0, 0);
+	uint8_t status = telemetry_scheduler_add_channel(&scheduler, 2, 0, 1);
+	
+	//Priority 1 has to leave 50 bytes: 150 fit, 151 don't. The priority 0 channel can empty the bucket
+	scheduler_check(!telemetry_scheduler_admit(&scheduler, events, 151, 1000, 0), "reserve kept back from priority 1");
+	scheduler_check(telemetry_scheduler_admit(&scheduler, events, 150, 1000, 0), "priority 1 fits above the reserve");
+	scheduler_check(telemetry_scheduler_admit(&scheduler, samples, 50, 1000, 0), "priority 0 takes the rest");
+	scheduler_check(!telemetry_scheduler_admit(&scheduler, samples, 1, 1000, 0), "empty bucket refuses everything");
+	
+	//Refused event messages stay at one at a time: the next one to fit goes out straight away
+	for (uint8_t i = 0; i < 5; i++)
+		scheduler_check(!telemetry_scheduler_admit(&scheduler, events, 20, 1000, 0), "event refused on an empty bucket");
+	scheduler_check(scheduler.channels[events].decimation == 1, "event channel isn't decimated");
+	scheduler_check(telemetry_scheduler_admit(&scheduler, events, 20, 1000, 100), "event sent as soon as it fits");
+	
+	//A refused periodic channel is thinned out, doubling each time
+	telemetry_scheduler_init(&scheduler, 10000, 200, 50, 1000);
+	samples = telemetry_scheduler_add_channel(&scheduler, 0, 0, 1);
+	events = telemetry_scheduler_add_channel(&scheduler, 1, 0, 0);
+	status = telemetry_scheduler_add_channel(&scheduler, 2, 0, 1);
+	scheduler_check(!telemetry_scheduler_admit(&scheduler, status, 101, 1000, 1000), "priority 2 refused into its reserve");
+	scheduler_check(scheduler.channels[status].decimation == 2, "periodic channel decimated after a refusal");
+	scheduler_check(!telemetry_scheduler_admit(&scheduler, status, 10, 1000, 1000), "decimation skips the next message");
+	scheduler_check(telemetry_scheduler_admit(&scheduler, status, 10, 1000, 1000), "and offers the one after");
+	
+	//...and relaxed again once it keeps fitting
+	uint8_t sent = 0;
+	for (uint8_t i = 0; i < 2 * TELEMETRY_RELAX_AFTER; i++)
+		sent += telemetry_scheduler_admit(&scheduler, status, 1, 1000, 1000 + i * 10);
+	scheduler_check(scheduler.channels[status].decimation == 1, "decimation relaxed after fitting");
+	scheduler_check(sent >= TELEMETRY_RELAX_AFTER - 1, "decimated channel still sends every other message");
+	
+	//Queue space is checked too, and never decimates an event channel either
+	scheduler_check(!telemetry_scheduler_admit(&scheduler, events, 30, 29, 2000), "refused when the queue is short");
+	scheduler_check(scheduler.channels[events].decimation == 1 && telemetry_scheduler_admit(&scheduler, events, 30, 30, 2000),
+			"event channel sends once the queue has room");
+	
+	printf("test_telemetry_scheduler: %s\n", scheduler_test_failures ? "FAIL" : "PASS");
+	return scheduler_test_failures != 0;
+}
+
+#endif
@@ -0,0 +1,61 @@
+/*
+ * TelemetryScheduler.h
+ *
+ * Decides which telemetry messages go out when the link can't carry all of them.
+ *
+ * The link is modelled as a token bucket: it fills at the baud rate's byte rate (10 bits per byte for 8N1)
+ * up to burst_bytes, and every message sent takes its length out. Each channel has a priority (0 is highest).
+ * A channel of priority p may only spend the bucket down to p * reserve_bytes, so lower priorities run out first
+ * and the highest priority always has room. A periodic channel that gets refused is decimated (only every Nth message
+ * is offered), doubling each time up to TELEMETRY_MAX_DECIMATION, and is relaxed again once it keeps fitting: the next
+ * message will carry much the same news. Event channels (acks, one-off reports) are only ever refused a message at a
+ * time, since every one of their messages matters.
+ *
+ * Doesn't depend on anything AVR specific.
+ */
+
+
+#ifndef TELEMETRYSCHEDULER_H_
+#define TELEMETRYSCHEDULER_H_
+
+#include <inttypes.h>
+
+#define TELEMETRY_MAX_CHANNELS		4
+#define TELEMETRY_MAX_DECIMATION	64
+#define TELEMETRY_RELAX_AFTER		32 //Messages in a row that fit before a channel's decimation is halved
+
+typedef struct TelemetryChannel
+{
+	uint8_t priority; //0 = most important
+	uint16_t min_interval_ms; //Rate limit. 0 = no limit
+	uint8_t periodic; //1 = decimated when refused, 0 = event channel, never decimated
+	uint8_t decimation; //Only every decimation-th message is considered. 1 = all of them
+	uint8_t decimation_count;
+	uint8_t fit_streak;
+	uint32_t last_sent_ms;
+	uint32_t sent;
+	uint32_t dropped; //Refused for budget, queue space or rate limit, or skipped by decimation
+} TelemetryChannel_t;
+
+typedef struct TelemetryScheduler
+{
+	uint32_t bytes_per_second;
+	uint32_t tokens_milli; //Bytes available, times 1000 so partial bytes per ms aren't lost
+	uint32_t burst_bytes; //Bucket size. About the size of the transmit queue
+	uint16_t reserve_bytes; //Headroom kept back per priority level
+	uint32_t last_refill_ms;
+	TelemetryChannel_t channels[TELEMETRY_MAX_CHANNELS];
+	uint8_t channel_count;
+} TelemetryScheduler_t;
+
+void telemetry_scheduler_init(TelemetryScheduler_t* scheduler, uint32_t baudrate, uint32_t burst_bytes, uint16_t reserve_bytes, uint32_t now_ms);
+void telemetry_scheduler_set_baudrate(TelemetryScheduler_t* scheduler, uint32_t baudrate);
+uint8_t telemetry_scheduler_add_channel(TelemetryScheduler_t* scheduler, uint8_t priority, uint16_t min_interval_ms, uint8_t periodic);
+uint8_t telemetry_scheduler_admit(TelemetryScheduler_t* scheduler, uint8_t channel, uint16_t length, uint16_t queue_free, uint32_t now_ms);
+
+//-------For testing/debugging-----------
+#ifdef DEBUG
+uint8_t test_telemetry_scheduler(void);
+#endif
+
+#endif /* TELEMETRYSCHEDULER_H_ */
@@ -0,0 +1,28 @@
+/*
+ * conf_acquisition.h
+ *
+ * Hardware used by drivers/Acquisition.h: a period timer whose overflow is routed through the event system to restart a
+ * conversion timer, so both count from the same instant.
+ */
+
+
+#ifndef CONF_ACQUISITION_H_INCLUDED
+#define CONF_ACQUISITION_H_INCLUDED
+
+#define ACQUISITION_PERIOD_TC			TCD0
+#define ACQUISITION_PERIOD_OVF_vect		TCD0_OVF_vect
+#define ACQUISITION_PERIOD_PRESCALER	TC_CLKSEL_DIV64_gc
+#define ACQUISITION_PERIOD_TICKS_PER_MS	500 //32 MHz / 64
+
+#define ACQUISITION_CONVERSION_TC		TCD1 //Same tick rate as the timebase, so its count can be taken straight off timebase_ticks()
+#define ACQUISITION_CONVERSION_CCA_vect	TCD1_CCA_vect
+#define ACQUISITION_CONVERSION_CCB_vect	TCD1_CCB_vect
+#define ACQUISITION_CONVERSION_PRESCALER	TC_CLKSEL_DIV8_gc
+
+#define ACQUISITION_EVENT_MUX			EVSYS.CH5MUX
+#define ACQUISITION_EVENT_SOURCE		EVSYS_CHMUX_TCD0_OVF_gc //ACQUISITION_PERIOD_TC's overflow
+#define ACQUISITION_EVENT_SELECT		TC_EVSEL_CH5_gc
+
+#define ACQUISITION_MARGIN_US			200 //Spare time per sample on top of the two conversions, for the SPI transfers and interrupt entry
+
+#endif /* CONF_ACQUISITION_H_INCLUDED */
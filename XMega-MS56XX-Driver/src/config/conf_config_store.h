@@ -0,0 +1,15 @@
+/*
+ * conf_config_store.h
+ *
+ * Where drivers/ConfigStore.h keeps its records in EEPROM. Each slot is CONFIG_RECORD_LENGTH (16) bytes.
+ * More slots spread the wear further but make the boot scan longer; 64 slots read in well under a millisecond.
+ */
+
+
+#ifndef CONF_CONFIG_STORE_H_INCLUDED
+#define CONF_CONFIG_STORE_H_INCLUDED
+
+#define CONFIG_STORE_START			0 //Byte address in EEPROM. Keep it a multiple of 16
+#define CONFIG_STORE_SLOTS			64
+
+#endif /* CONF_CONFIG_STORE_H_INCLUDED */
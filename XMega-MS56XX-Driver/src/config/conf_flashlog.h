@@ -0,0 +1,15 @@
+/*
+ * conf_flashlog.h
+ *
+ * Where in flash drivers/FlashLog.h keeps its records. Both must be page aligned (FLASH_PAGE_SIZE, 512 bytes on the 128A1U).
+ * The program itself has to stay below FLASHLOG_START; check the .text size in the build output.
+ */
+
+
+#ifndef CONF_FLASHLOG_H_INCLUDED
+#define CONF_FLASHLOG_H_INCLUDED
+
+#define FLASHLOG_START				0x10000UL //Upper half of the 128 KiB application section
+#define FLASHLOG_END				0x20000UL //Start of the boot section
+
+#endif /* CONF_FLASHLOG_H_INCLUDED */
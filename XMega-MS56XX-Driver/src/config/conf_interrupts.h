@@ -0,0 +1,68 @@
+/*
+ * conf_interrupts.h
+ *
+ * Interrupt priority plan. Each interrupt's level is chosen by what it costs when it runs late:
+ *
+ * High		Sensor acquisition (drivers/Acquisition.h). A late period overflow moves the instant the sample is taken.
+ * Medium	USART receive, and the transmit DMA channel finishing a span. A late receive loses command bytes once the USART's
+ *			buffer fills; a late DMA interrupt only leaves the link idle, but it's short and shares the USART with receive.
+ * Low		Telemetry: USART transmit by the DRE interrupt. Also the timebase overflow and sleep wake-up, which can wait
+ *			for minutes without harm (see timebase_ticks). Serviced round robin, so a saturated UART can't starve them.
+ *
+ * Latency budget at 32 MHz (32 cycles per us):
+ *
+ * High, ACQUISITION_MAX_LATENCY_US from the period overflow to the D1 command going out. The overflow interrupt sends it
+ * before doing anything else, and no profiler markers run in interrupts, so DEBUG builds have the same budget:
+ *	- finishing the current instruction and entering the interrupt: under 20 cycles
+ *	- the interrupt's prologue, saving the registers its calls can clobber: about 30 cycles
+ *	- the segment count and state check: about 15 cycles
+ *	- sending the D1 command itself, select, one byte at 16 MHz and deselect: about 70 cycles
+ *	- the longest stretch with interrupts off, timebase_sleep_until's deadline check and compare set up: about 300 cycles
+ *	  of 64 bit arithmetic and timer reads. The UART queue updates and acquisition_read's copy are under 100 each
+ *	- the previous sample's interrupts: never, acquisition_fits leaves ACQUISITION_MARGIN_US before the next period
+ *	So about 435 cycles, 14 us, at worst. The rest of the overflow interrupt (reading the conversion timer and the
+ *	timebase, with timebase_ticks' retry, setting the compare, about 250 cycles) comes after the command, so it only
+ *	counts towards the medium level's budget. Reading the results is less urgent: the sensor holds them until the next
+ *	command, and a late read only delays the sample, not its timestamp. Lateness is measured on every sample
+ *	(acquisition_max_latency) and over-budget samples are counted in the status frame.
+ *	Flash log page erases and writes are outside the budget: the application section can't be read while one is in progress,
+ *	so anything executing from it, interrupts included, may stall until it finishes (a few ms). The samples that delays,
+ *	or loses altogether when the stall covers whole periods, count as late too.
+ *
+ * Medium, the time the USART's two byte receive buffer plus its shift register cover:
+ *	- the longest high level interrupt, the period overflow: about 400 cycles, 13 us. Reading D1 and starting D2 is
+ *	  about 10 us. One catching up after a flash stall also does a 32 bit division, about 20 us in all, but the stall
+ *	  itself has already cost far more than that
+ *	- plus the same interrupts-off stretches and entry as high level: about 10 us
+ *	About 23 us, so receive keeps up to 921600 baud (3 bytes = 33 us). At 2 Mbaud (15 us) a byte can be lost while an
+ *	acquisition interrupt runs; that is counted in UART_rx_overruns.
+ *
+ * Low: no deadline. At full load the high and medium interrupts take under 1% of the CPU, which leaves the UART's
+ *	throughput alone.
+ */
+
+
+#ifndef CONF_INTERRUPTS_H_INCLUDED
+#define CONF_INTERRUPTS_H_INCLUDED
+
+//High
+#define ACQUISITION_OVF_INTLVL			TC_OVFINTLVL_HI_gc
+#define ACQUISITION_CCA_INTLVL			TC_CCAINTLVL_HI_gc
+#define ACQUISITION_CCB_INTLVL			TC_CCBINTLVL_HI_gc
+#define ACQUISITION_PMIC_LEVEL			PMIC_LVL_HIGH
+#define ACQUISITION_MAX_LATENCY_US		16 //Budget above, with a little margin
+
+//Medium
+#define USART_SERIAL_RXC_INTLVL			USART_INT_LVL_MED
+#define USART_SERIAL_RX_PMIC_LEVEL		PMIC_LVL_MEDIUM
+#define USART_SERIAL_DMA_INTLVL			(DMA_CH_TRNINTLVL_MED_gc | DMA_CH_ERRINTLVL_MED_gc)
+#define USART_SERIAL_DMA_PMIC_LEVEL		PMIC_LVL_MEDIUM
+
+//Low
+#define USART_SERIAL_DRE_INTLVL			USART_INT_LVL_LO
+#define USART_SERIAL_TX_PMIC_LEVEL		PMIC_LVL_LOW
+#define TIMEBASE_OVF_INTLVL				TC_OVFINTLVL_LO_gc
+#define TIMEBASE_WAKE_INTLVL			TC_CCAINTLVL_LO_gc
+#define TIMEBASE_PMIC_LEVEL				PMIC_LVL_LOW
+
+#endif /* CONF_INTERRUPTS_H_INCLUDED */
@@ -0,0 +1,31 @@
+/*
+ * conf_profiler.h
+ *
+ * Hardware and regions used by drivers/Profiler.h. Only used in DEBUG builds.
+ */
+
+
+#ifndef CONF_PROFILER_H_INCLUDED
+#define CONF_PROFILER_H_INCLUDED
+
+#define PROFILER_LOW_TC				TCF0 //Counts the CPU clock
+#define PROFILER_HIGH_TC			TCF1 //Counts PROFILER_LOW_TC overflows
+#define PROFILER_EVENT_MUX			EVSYS.CH6MUX //Next to the timebase's channel 7
+#define PROFILER_EVENT_SOURCE		EVSYS_CHMUX_TCF0_OVF_gc
+#define PROFILER_EVENT_CLKSEL		TC_CLKSEL_EVCH6_gc
+
+//One per instrumented piece of code, none of it run from interrupts. Keep PROFILER_REGION_NAMES in the same order
+typedef enum {
+	PROFILE_ACQUISITION_READ,
+	PROFILE_READ16, //Two spireads, from calibratePressureSensor
+	PROFILE_SEND_SAMPLE,
+	PROFILE_FLASHLOG_APPEND,
+	PROFILE_POLL_COMMANDS,
+	PROFILE_FMT_SAMPLE_LINE, //benchmark_format
+	PROFILE_SNPRINTF_SAMPLE_LINE,
+	PROFILE_REGIONS
+} ProfileRegion;
+
+#define PROFILER_REGION_NAMES		{"acquisition_read", "read16", "send_sample", "flashlog_append", "poll_commands", "fmt_line", "snprintf_line"}
+
+#endif /* CONF_PROFILER_H_INCLUDED */
@@ -0,0 +1,25 @@
+/*
+ * conf_ringbuffer.h
+ *
+ * Ring buffer configuration
+ */
+
+#ifndef CONF_RINGBUFFER_H_INCLUDED
+#define CONF_RINGBUFFER_H_INCLUDED
+
+//Uncomment to keep high-water marks, overrun counts, byte totals and data age in every RingBufferu8_t and RingBufferSPSC_t
+//Costs a RingBufferStats_t (24 bytes plus 8 per span) per buffer and a few cycles per call, so leave it off for flight unless sizing buffers
+//#define RINGBUFFER_STATS
+
+//Writes whose timestamps are kept for the data age statistic. One slot is always free and one holds the span being read,
+//so ages are exact while no more than RINGBUFFER_STATS_SPANS - 2 newer writes are queued behind the oldest byte
+#define RINGBUFFER_STATS_SPANS		6
+
+//RINGBUFFER_STATS_TIME names the time source for the data age statistic: a uint32_t function(void) returning any
+//free-running count, in whatever units it counts in. It belongs to the application, so it isn't set here; this project
+//sets it to timebase_us in its compiler symbols. Left unset, ages aren't measured and max_age stays 0
+
+//Most readers a RingBufferBroadcast_t can have. Each one costs 2 bytes per buffer, and must be 8 or less
+#define RB_BROADCAST_MAX_READERS	4
+
+#endif /* CONF_RINGBUFFER_H_INCLUDED */
@@ -0,0 +1,21 @@
+/*
+ * conf_timebase.h
+ *
+ * Hardware used by drivers/Timebase.h: two 16 bit timers on the same port, cascaded through an event channel.
+ */
+
+
+#ifndef CONF_TIMEBASE_H_INCLUDED
+#define CONF_TIMEBASE_H_INCLUDED
+
+#define TIMEBASE_LOW_TC				TCE0 //Counts the prescaled CPU clock
+#define TIMEBASE_HIGH_TC			TCE1 //Counts TIMEBASE_LOW_TC overflows
+#define TIMEBASE_HIGH_OVF_vect		TCE1_OVF_vect
+#define TIMEBASE_LOW_CCA_vect		TCE0_CCA_vect //Wakes timebase_sleep_until
+#define TIMEBASE_EVENT_MUX			EVSYS.CH7MUX //Channel 7, to stay out of the way of anything else using the event system
+#define TIMEBASE_EVENT_SOURCE		EVSYS_CHMUX_TCE0_OVF_gc //TIMEBASE_LOW_TC's overflow
+#define TIMEBASE_EVENT_CLKSEL		TC_CLKSEL_EVCH7_gc
+#define TIMEBASE_PRESCALER			TC_CLKSEL_DIV8_gc
+#define TIMEBASE_TICKS_PER_US		4 //32 MHz / 8
+
+#endif /* CONF_TIMEBASE_H_INCLUDED */
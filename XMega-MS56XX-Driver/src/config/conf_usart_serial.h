@@ -47,9 +47,24 @@
 #ifndef CONF_USART_SERIAL_H_INCLUDED
 #define CONF_USART_SERIAL_H_INCLUDED
 
-#define USART_SERIAL_BAUDRATE		115200
+#define USART_SERIAL_BAUDRATE		115200 //At 32 MHz, 460800, 921600 and 2000000 also come out within 0.1%
+#define USART_SERIAL_MAX_BAUD_ERROR_PPM	20000 //UART_set_baudrate refuses anything further off than this (2%)
 #define USART_SERIAL_CHAR_LENGTH	USART_CHSIZE_8BIT_gc
 #define USART_SERIAL_PARITY			USART_PMODE_DISABLED_gc
 #define USART_SERIAL_STOP_BIT		true
 
+//Interrupt-driven transmit (UART_tx_interrupt_init in uart_tools.h)
+//The vector has to match the USART passed to UART_tx_interrupt_init
+#define USART_SERIAL_DRE_vect		USARTC0_DRE_vect
+#define USART_SERIAL_TX_BUFFER_SIZE	256 //At most RBSPSC_MAX_ARRAY_LENGTH, like the receive buffer
+
+//Interrupt-driven receive (UART_rx_interrupt_init). The vector has to match the USART passed in
+#define USART_SERIAL_RXC_vect		USARTC0_RXC_vect
+#define USART_SERIAL_RX_BUFFER_SIZE	64
+
+//DMA transmit (UART_tx_dma_init). Channel, trigger and vector have to agree with each other and with the USART
+#define USART_SERIAL_DMA_CHANNEL	DMA.CH0
+#define USART_SERIAL_DMA_TRIGGER	DMA_CH_TRIGSRC_USARTC0_DRE_gc
+#define USART_SERIAL_DMA_vect		DMA_CH0_vect
+
 #endif /* CONF_USART_SERIAL_H_INCLUDED */
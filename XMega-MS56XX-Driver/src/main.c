@@ -1,27 +1,692 @@
 #include <asf.h>
 #include <stdio.h>
+#include "config/conf_usart_serial.h"
 #include "drivers/uart_tools.h"
 #include "drivers/SPI.h"
 #include "drivers/MS56XX.h"
+#include "drivers/FlashLog.h"
+#include "drivers/ConfigStore.h"
+#include "drivers/Timebase.h"
+#include "drivers/Profiler.h"
+#include "drivers/Acquisition.h"
+#include "tools/Telemetry.h"
+#include "tools/Format.h"
+#include "tools/CommandParser.h"
+#include "tools/DeltaStream.h"
+#include "tools/TelemetryScheduler.h"
+#include "tools/TaskScheduler.h"
+#include "tools/RingBuffer.h"
 
 #define COMMS_USART				USARTC0
 #define USART_TX_PIN			IOPORT_CREATE_PIN(PORTC, 3)
 #define USART_RX_PIN			IOPORT_CREATE_PIN(PORTC, 2)
-#define PRESSURE_SELECT_PIN		IOPORT_CREATE_PIN(PORTC, 4)
+#define PRESSURE_SELECT_PIN		IOPORT_CREATE_PIN(PORTC, 4) //Default, P command changes it
 
+//settings.output_format
+#define OUTPUT_TEXT				0 //Human readable lines
+#define OUTPUT_BINARY			1 //Frames from tools/Telemetry.h
+#define OUTPUT_DELTA			2 //Batches of delta compressed samples in TELEMETRY_TYPE_DELTA frames
+#define OUTPUT_RAW				3 //TELEMETRY_TYPE_RAW frames, compensated on the ground, with TELEMETRY_TYPE_CALIBRATION frames mixed in
+//Every format but text is a stream of COBS frames, and a single line of text in it garbles the next frame for the decoder.
+//So anything that isn't a sample (acks, status, reports) checks this rather than comparing with one particular format
+#define OUTPUT_FRAMED()			(settings.output_format != OUTPUT_TEXT)
+
+#define DELTA_BATCH_SAMPLES		16 //Samples per TELEMETRY_TYPE_DELTA frame. Each frame starts with a keyframe
+
+#define RAW_CALIBRATION_INTERVAL	32 //Raw samples per calibration frame, so a ground station that starts late can still compensate
+
+#define STATUS_PERIOD_MS		1000
+#define POLL_PERIOD_US			1000 //How often finished samples and commands are picked up
+#define READOUT_RETRY_US		1000 //Wait before trying to send more of the flash log when the link was full
+#define REPORT_RETRY_US			1000 //Wait before resending a report row the link turned down, see run_report
+#define FILTER_WINDOW			16 //Samples the pressure statistics in the status frame cover
+#define READOUT_RECORDS			4 //Flash log samples per TELEMETRY_TYPE_LOG frame
+#define PRIORITY_SAMPLES		0 //Never decimated, so pressure data is only lost if the link itself is too slow
+#define PRIORITY_ACKS			1
+#define PRIORITY_READOUT		1
+#define PRIORITY_STATUS			2
+
+//settings.sensors bits
+#define SENSOR_PRESSURE			0x01
+
+//Commands whose settings are kept in the EEPROM config store. The key is the letter's position here, so only ever append
+static const char stored_commands[] = {'O', 'R', 'F', 'S', 'B', 'P'};
+
+typedef struct Settings
+{
+	OSR_Settings osr;
+	uint16_t sample_period_ms;
+	uint8_t output_format;
+	uint8_t sensors;
+	uint32_t baudrate;
+	ioport_pin_t pressure_select_pin;
+} Settings_t;
+
+static Settings_t settings = {
+	.osr = OSR_4096,
+	.sample_period_ms = 1000,
+	.output_format = OUTPUT_BINARY,
+	.sensors = SENSOR_PRESSURE,
+	.baudrate = USART_SERIAL_BAUDRATE,
+	.pressure_select_pin = PRESSURE_SELECT_PIN
+};
+
+static uint16_t telemetry_sequence = 0;
+
+static DeltaEncoder_t delta_encoder;
+static uint8_t delta_batch[TELEMETRY_MAX_PAYLOAD];
+static uint8_t delta_batch_length = 0;
+static uint8_t delta_batch_samples = 0;
+
+static uint8_t raw_since_calibration = 0;
+
+static TelemetryScheduler_t scheduler;
+static uint8_t channel_samples, channel_acks, channel_status, channel_readout;
+static uint8_t sample_active_percent = 100; //From the last sample
+
+//Main loop work, see tools/TaskScheduler.h. Each new sample releases the filter, log and telemetry tasks in that order
+static TaskScheduler_t tasks;
+static uint8_t task_filter, task_log, task_telemetry, task_readout, task_report;
+static CommandParser_t parser;
+
+static RingBuffer32Agg_t pressure_window;
+static int32_t pressure_window_array[FILTER_WINDOW + 1];
+static uint16_t pressure_min_queue[FILTER_WINDOW + 1];
+static uint16_t pressure_max_queue[FILTER_WINDOW + 1];
+
+static uint8_t readout_active = 0;
+static uint32_t readout_position = 0; //Flash log slot the next TELEMETRY_TYPE_LOG frame starts from
+
+static uint8_t (*report_send_row)(uint8_t row) = NULL; //Sends one row of the report in progress, see start_report
+static uint8_t report_row = 0, report_rows = 0; //Next row to send and rows in the report
+
+static void make_sample(MS56XX_t* sensor, TelemetrySample_t* sample);
+static uint8_t send_on_channel(uint8_t channel, const uint8_t* data, uint16_t length);
+static uint8_t send_frame(uint8_t channel, const uint8_t* frame, uint8_t length);
+static void send_sample(MS56XX_t* sensor);
+static void send_delta_batch(void);
+static void send_calibration(MS56XX_t* sensor);
+static void send_ack(char letter, uint8_t status);
+static void send_status(void);
+static uint8_t send_task_row(uint8_t number);
+#ifdef DEBUG
+static uint8_t send_profile_row(uint8_t region);
+#endif
+static void continue_readout(void);
+static void start_report(uint8_t (*send_row)(uint8_t row), uint8_t rows);
+static uint8_t is_select_pin(int32_t pin);
+static uint8_t apply_command(const Command_t* command, MS56XX_t* sensor);
+static void store_setting(const Command_t* command);
+static void load_settings(MS56XX_t* sensor);
+static void poll_commands(CommandParser_t* parser, MS56XX_t* sensor);
+static uint8_t restart_acquisition(MS56XX_t* sensor);
+static void run_acquisition(void* sensor);
+static void run_filter(void* sensor);
+static void run_log(void* sensor);
+static void run_telemetry(void* sensor);
+static void run_commands(void* sensor);
+static void run_readout(void* unused);
+static void run_report(void* unused);
+static void run_status(void* unused);
+
+
+static void make_sample(MS56XX_t* sensor, TelemetrySample_t* sample)
+{
+	sample->timestamp = sensor->data.timestamp;
+	sample->pressure = sensor->data.pressure;
+	sample->temperature = sensor->data.temperature;
+	sample->flags = sensor->data.valid ? TELEMETRY_FLAG_VALID : 0;
+}
+
+static uint8_t send_on_channel(uint8_t channel, const uint8_t* data, uint16_t length)
+/*	Queues data for transmission if the scheduler says the link has room for it, otherwise drops it
+	Returns 1 if it was queued, 0 if it was dropped
+*/
+{
+	if (!telemetry_scheduler_admit(&scheduler, channel, length, UART_tx_free_space(), timebase_ms()))
+		return 0;
+	UART_write(data, length);
+	return 1;
+}
+
+static uint8_t send_frame(uint8_t channel, const uint8_t* frame, uint8_t length)
+/*	send_on_channel for a frame encoded with telemetry_sequence. The sequence only moves on once the frame is queued,
+	so frames the scheduler drops (already counted in its channel stats) don't show up as link losses on the ground
+	Returns 1 if it was queued, 0 if it was dropped
+*/
+{
+	if (!send_on_channel(channel, frame, length))
+		return 0;
+	telemetry_sequence++;
+	return 1;
+}
+
+static void send_sample(MS56XX_t* sensor)
+{
+	if (settings.output_format == OUTPUT_BINARY)
+	{
+		uint8_t frame[TELEMETRY_MAX_FRAME];
+		TelemetrySample_t sample;
+		make_sample(sensor, &sample);
+		send_frame(channel_samples, frame, telemetry_encode_sample(telemetry_sequence, &sample, frame));
+	}
+	else if (settings.output_format == OUTPUT_DELTA)
+	{
+		if (TELEMETRY_MAX_PAYLOAD - delta_batch_length < DELTA_MAX_RECORD_LENGTH)
+			send_delta_batch();
+		if (delta_batch_length == 0)
+			delta_encoder_force_keyframe(&delta_encoder); //So each frame decodes on its own if the one before is lost
+		delta_batch_length += delta_encode_sample(&delta_encoder, sensor->data.pressure, sensor->data.temperature, &delta_batch[delta_batch_length]);
+		if (++delta_batch_samples == DELTA_BATCH_SAMPLES)
+			send_delta_batch();
+	}
+	else if (settings.output_format == OUTPUT_RAW)
+	{
+		if (raw_since_calibration == 0)
+			send_calibration(sensor);
+		raw_since_calibration = (raw_since_calibration + 1) % RAW_CALIBRATION_INTERVAL;
+		
+		uint8_t frame[TELEMETRY_MAX_FRAME];
+		uint8_t payload[13];
+		telemetry_put_u32(&payload[0], sensor->data.timestamp);
+		telemetry_put_u32(&payload[4], sensor->data.raw_pressure);
+		telemetry_put_u32(&payload[8], sensor->data.raw_temperature);
+		payload[12] = sensor->data.valid ? TELEMETRY_FLAG_VALID : 0;
+		send_frame(channel_samples, frame, telemetry_encode_frame(TELEMETRY_TYPE_RAW, telemetry_sequence, payload, sizeof(payload), frame));
+	}
+	else
+	{
+		//Same text as printf("Pressure is %" PRIi32 ", temperature is %" PRIi32 ", %s\n", ...) without pulling in vfprintf
+		char line[FORMAT_MAX_SAMPLE_LINE];
+		send_on_channel(channel_samples, (uint8_t*)line, fmt_sample_line(line, sensor->data.pressure, sensor->data.temperature, sensor->data.valid));
+	}
+}
+
+static void send_delta_batch(void)
+//Sends whatever delta records have built up as one frame
+{
+	if (delta_batch_length == 0)
+		return;
+	uint8_t frame[TELEMETRY_MAX_FRAME];
+	send_frame(channel_samples, frame, telemetry_encode_frame(TELEMETRY_TYPE_DELTA, telemetry_sequence, delta_batch, delta_batch_length, frame));
+	delta_batch_length = 0;
+	delta_batch_samples = 0;
+}
+
+static void send_calibration(MS56XX_t* sensor)
+//The sensor's PROM coefficients, so the ground station can compensate raw samples itself
+{
+	uint8_t frame[TELEMETRY_MAX_FRAME];
+	uint8_t payload[13];
+	payload[0] = sensor->model;
+	telemetry_put_u16(&payload[1], sensor->calibration.SENSt1);
+	telemetry_put_u16(&payload[3], sensor->calibration.OFFt1);
+	telemetry_put_u16(&payload[5], sensor->calibration.TCS);
+	telemetry_put_u16(&payload[7], sensor->calibration.TCO);
+	telemetry_put_u16(&payload[9], sensor->calibration.Tref);
+	telemetry_put_u16(&payload[11], sensor->calibration.TEMPSENS);
+	send_frame(channel_samples, frame, telemetry_encode_frame(TELEMETRY_TYPE_CALIBRATION, telemetry_sequence, payload, sizeof(payload), frame));
+}
+
+static void send_ack(char letter, uint8_t status)
+//Tells the ground station whether a command was applied, in whichever format it's currently reading
+{
+	if (OUTPUT_FRAMED())
+	{
+		uint8_t frame[TELEMETRY_MAX_FRAME];
+		uint8_t payload[2] = {(uint8_t)letter, status};
+		send_frame(channel_acks, frame, telemetry_encode_frame(TELEMETRY_TYPE_ACK, telemetry_sequence, payload, 2, frame));
+	}
+	else
+	{
+		char line[8];
+		uint8_t length = fmt_string(line, status ? "ERR " : "OK ");
+		line[length++] = letter;
+		line[length++] = '\n';
+		send_on_channel(channel_acks, (uint8_t*)line, length);
+	}
+}
+
+static void send_status(void)
+//Link health for the ground station. Binary formats only; the scheduler drops these first when the link is busy
+{
+	if (!OUTPUT_FRAMED())
+		return;
+	static uint64_t last_ticks = 0, last_slept = 0;
+	uint64_t ticks = timebase_ticks(), slept = timebase_slept_ticks();
+	uint32_t elapsed = (uint32_t)(ticks - last_ticks);
+	uint8_t frame[TELEMETRY_MAX_FRAME];
+	uint8_t payload[38];
+	telemetry_put_u32(&payload[0], timebase_ms());
+	telemetry_put_u32(&payload[4], UART_rx_overruns());
+	telemetry_put_u32(&payload[8], scheduler.channels[channel_samples].dropped);
+	telemetry_put_u32(&payload[12], scheduler.channels[channel_status].dropped);
+	payload[16] = sample_active_percent;
+	payload[17] = elapsed ? (uint8_t)(100 - (uint64_t)(slept - last_slept) * 100 / elapsed) : 100; //Whole firmware since the last status
+	telemetry_put_u32(&payload[18], acquisition_late_samples());
+	uint8_t filtered = rb32agg_length(&pressure_window) != 0;
+	telemetry_put_u32(&payload[22], (uint32_t)rb32agg_mean(&pressure_window));
+	telemetry_put_u32(&payload[26], filtered ? (uint32_t)rb32agg_min(&pressure_window) : 0);
+	telemetry_put_u32(&payload[30], filtered ? (uint32_t)rb32agg_max(&pressure_window) : 0);
+	telemetry_put_u32(&payload[34], UART_tx_dropped());
+	last_ticks = ticks;
+	last_slept = slept;
+	send_frame(channel_status, frame, telemetry_encode_frame(TELEMETRY_TYPE_STATUS, telemetry_sequence, payload, sizeof(payload), frame));
+}
+
+static uint8_t send_task_row(uint8_t number)
+/*	One line or TELEMETRY_TYPE_TASK frame for a main loop task, on the acks channel. Sent a row at a time by run_report
+	Returns 1 if it was queued, 0 if the scheduler turned it down
+*/
+{
+	Task_t* task = &tasks.tasks[number];
+	const char* name = task->name;
+	if (!OUTPUT_FRAMED())
+	{
+		char line[40 + 4 * FORMAT_MAX_I32_LENGTH + 16]; //Text, numbers and the name
+		uint8_t length = fmt_string(line, name);
+		length += fmt_string(line + length, ": ");
+		length += fmt_u32(line + length, task->runs);
+		length += fmt_string(line + length, " runs, ");
+		length += fmt_u32(line + length, task->overruns);
+		length += fmt_string(line + length, " overruns, max ");
+		length += fmt_u32(line + length, task->max_runtime_us);
+		length += fmt_string(line + length, " us, mean ");
+		length += fmt_u32(line + length, task->runs ? (uint32_t)(task->total_runtime_us / task->runs) : 0);
+		length += fmt_string(line + length, " us\n");
+		return send_on_channel(channel_acks, (uint8_t*)line, length);
+	}
+	else
+	{
+		uint8_t frame[TELEMETRY_MAX_FRAME];
+		uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+		payload[0] = number;
+		telemetry_put_u32(&payload[1], task->runs);
+		telemetry_put_u32(&payload[5], task->overruns);
+		telemetry_put_u32(&payload[9], task->max_runtime_us);
+		telemetry_put_u32(&payload[13], (uint32_t)task->total_runtime_us);
+		telemetry_put_u32(&payload[17], (uint32_t)(task->total_runtime_us >> 32));
+		telemetry_put_u32(&payload[21], task->max_lateness_us);
+		uint8_t length = 25;
+		while (*name && length < TELEMETRY_MAX_PAYLOAD)
+			payload[length++] = *name++;
+		return send_frame(channel_acks, frame, telemetry_encode_frame(TELEMETRY_TYPE_TASK, telemetry_sequence, payload, length, frame));
+	}
+}
+
+#ifdef DEBUG
+static uint8_t send_profile_row(uint8_t region)
+/*	One line or TELEMETRY_TYPE_PROFILE frame for a profiler region, on the acks channel. Sent a row at a time by run_report
+	Returns 1 if it was queued, 0 if the scheduler turned it down
+*/
+{
+	ProfileStats_t stats;
+	profiler_get(region, &stats);
+	const char* name = profiler_region_name(region);
+	uint32_t min = stats.count ? stats.min : 0;
+	if (!OUTPUT_FRAMED())
+	{
+		char line[32 + 4 * FORMAT_MAX_I32_LENGTH + 16]; //Text, numbers and the name
+		uint8_t length = fmt_string(line, name);
+		length += fmt_string(line + length, ": ");
+		length += fmt_u32(line + length, stats.count);
+		length += fmt_string(line + length, " runs, ");
+		length += fmt_u32(line + length, min);
+		length += fmt_string(line + length, " - ");
+		length += fmt_u32(line + length, stats.max);
+		length += fmt_string(line + length, " cycles, mean ");
+		length += fmt_u32(line + length, stats.count ? (uint32_t)(stats.total / stats.count) : 0);
+		line[length++] = '\n';
+		return send_on_channel(channel_acks, (uint8_t*)line, length);
+	}
+	else
+	{
+		uint8_t frame[TELEMETRY_MAX_FRAME];
+		uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+		payload[0] = region;
+		telemetry_put_u32(&payload[1], stats.count);
+		telemetry_put_u32(&payload[5], min);
+		telemetry_put_u32(&payload[9], stats.max);
+		telemetry_put_u32(&payload[13], (uint32_t)stats.total);
+		telemetry_put_u32(&payload[17], (uint32_t)(stats.total >> 32));
+		uint8_t length = 21;
+		while (*name && length < TELEMETRY_MAX_PAYLOAD)
+			payload[length++] = *name++;
+		return send_frame(channel_acks, frame, telemetry_encode_frame(TELEMETRY_TYPE_PROFILE, telemetry_sequence, payload, length, frame));
+	}
+}
+#endif
+
+static void continue_readout(void)
+/*	Sends as much of the flash log as the link has room for, carrying on from where the last call stopped
+	Frames the scheduler turns down are retried next time, so nothing is skipped. Ends with an empty TELEMETRY_TYPE_LOG frame
+*/
+{
+	uint8_t frame[TELEMETRY_MAX_FRAME];
+	uint8_t payload[4 + READOUT_RECORDS * TELEMETRY_SAMPLE_PAYLOAD_LENGTH];
+	while (readout_active && UART_tx_free_space() >= TELEMETRY_MAX_FRAME)
+	{
+		uint32_t position = readout_position;
+		uint8_t count = flashlog_read(&position, &payload[4], READOUT_RECORDS);
+		telemetry_put_u32(&payload[0], readout_position);
+		uint8_t length = telemetry_encode_frame(TELEMETRY_TYPE_LOG, telemetry_sequence, payload, 4 + count * TELEMETRY_SAMPLE_PAYLOAD_LENGTH, frame);
+		if (!send_frame(channel_readout, frame, length))
+			return;
+		readout_position = position;
+		if (count == 0)
+			readout_active = 0;
+	}
+}
+
+static void start_report(uint8_t (*send_row)(uint8_t row), uint8_t rows)
+/*	Sends a report through task_report a row per run, so a long table doesn't go out in one burst the scheduler
+	would cut short. Replaces any report still in progress
+*/
+{
+	report_send_row = send_row;
+	report_row = 0;
+	report_rows = rows;
+	task_scheduler_schedule(&tasks, task_report, 0);
+}
+
+static uint8_t is_select_pin(int32_t pin)
+/*	Pins the P command may move the pressure sensor's select to. Not the USART (PC2, PC3), the rest of SPIC (PC5 - PC7)
+	or the LEDs (PORTE), which main drives itself. PC4 is SPIC's own SS, PORTD is free
+*/
+{
+	if (pin == PRESSURE_SELECT_PIN || pin == IOPORT_CREATE_PIN(PORTC, 0) || pin == IOPORT_CREATE_PIN(PORTC, 1))
+		return 1;
+	return pin >= IOPORT_CREATE_PIN(PORTD, 0) && pin <= IOPORT_CREATE_PIN(PORTD, 7);
+}
+
+static uint8_t apply_command(const Command_t* command, MS56XX_t* sensor)
+/*	Ground station commands:
+	O<osr>		Oversampling ratio: 4096, 2048, 1024, 512 or 256
+	R<ms>		Time between samples, 1 to 60000 ms. O and R are rejected if the conversions wouldn't fit in the period
+	F<format>	0 = text, 1 = binary frames, 2 = delta compressed binary frames, 3 = raw readings in binary frames
+	S<mask>		Which sensors to read. Bit 0 = pressure sensor
+	B<baud>		USART baud rate. Takes effect before the acknowledgement is sent
+	P<pin>		Pressure sensor select pin, as an ioport pin number (port * 8 + pin): PC0, PC1, PC4 or PORTD. Recalibrates from the sensor there,
+				and is rejected (keeping the old pin) if its PROM doesn't read back with a good CRC
+	L<0/1>		1 = send the whole flash log (TELEMETRY_TYPE_LOG frames), 0 = stop sending it
+	E1			Erase the flash log
+	Q<0-3>		0 = send the profiler's table, 1 = clear it, 2 = time the text formatting into it (benchmark_format),
+				3 = saturate the UART for 10 s and print whether every sample started on time (test_acquisition_deadlines,
+				text output only, clears the late sample count). DEBUG builds only
+	T<0/1>		0 = send each main loop task's runs, overruns and runtime, 1 = clear them
+	Return values
+	* 0 - applied
+	* 1 - rejected, nothing changed
+	Settings from O, R, F, S, B and P are stored in EEPROM and come back at the next reset
+*/
+{
+	int32_t value = command->value;
+	if (!command->has_value)
+		return 1;
+	
+	switch (command->letter)
+	{
+		case 'O':
+		{
+			OSR_Settings osr;
+			switch (value)
+			{
+				case 4096: osr = OSR_4096; break;
+				case 2048: osr = OSR_2048; break;
+				case 1024: osr = OSR_1024; break;
+				case 512: osr = OSR_512; break;
+				case 256: osr = OSR_256; break;
+				default: return 1;
+			}
+			if (!acquisition_fits(osr, settings.sample_period_ms))
+				return 1;
+			settings.osr = osr;
+			sensor->osr = osr;
+			return restart_acquisition(sensor);
+		}
+		case 'R':
+			if (value < 1 || value > 60000 || !acquisition_fits(sensor->osr, value))
+				return 1;
+			settings.sample_period_ms = value;
+			return restart_acquisition(sensor);
+		case 'F':
+			if (value != OUTPUT_TEXT && value != OUTPUT_BINARY && value != OUTPUT_DELTA && value != OUTPUT_RAW)
+				return 1;
+			send_delta_batch(); //Don't strand samples from before the switch
+			raw_since_calibration = 0;
+			settings.output_format = value;
+			return 0;
+		case 'S':
+			if (value & ~SENSOR_PRESSURE)
+				return 1;
+			settings.sensors = value;
+			return restart_acquisition(sensor);
+		case 'B':
+			if (value <= 0)
+				return 1;
+			UART_tx_flush(); //Don't garble what's already queued
+			if (!UART_set_baudrate(&COMMS_USART, value))
+				return 1;
+			settings.baudrate = value;
+			telemetry_scheduler_set_baudrate(&scheduler, value);
+			return 0;
+		case 'P':
+		{
+			if (!is_select_pin(value))
+				return 1;
+			ioport_pin_t old_pin = sensor->select_pin;
+			acquisition_stop(); //The acquisition interrupts use the SPI too
+			spideselect(old_pin);
+			sensor->select_pin = value;
+			enable_select_pin(sensor->select_pin);
+			if (calibratePressureSensor(sensor))
+			{
+				//Nothing answering there. Back to the sensor that was working
+				if (sensor->select_pin != PRESSURE_SELECT_PIN) //SPIC's SS has to stay an output or the SPI drops to slave mode
+					ioport_set_pin_dir(sensor->select_pin, IOPORT_DIR_INPUT);
+				sensor->select_pin = old_pin;
+				calibratePressureSensor(sensor);
+				restart_acquisition(sensor);
+				return 1;
+			}
+			settings.pressure_select_pin = value;
+			return restart_acquisition(sensor);
+		}
+		case 'L':
+			if (value != 0 && value != 1)
+				return 1;
+			if (value)
+			{
+				flashlog_flush(); //So the readout includes the latest samples
+				readout_position = 0;
+				task_scheduler_schedule(&tasks, task_readout, 0);
+			}
+			readout_active = value;
+			return 0;
+		case 'E':
+			if (value != 1)
+				return 1;
+			readout_active = 0;
+			flashlog_erase();
+			return 0;
+		case 'T':
+			if (value == 0)
+				start_report(send_task_row, tasks.task_count);
+			else if (value == 1)
+				task_scheduler_reset_stats(&tasks);
+			else
+				return 1;
+			return 0;
+#ifdef DEBUG
+		case 'Q':
+			if (value == 0)
+				start_report(send_profile_row, PROFILE_REGIONS);
+			else if (value == 1)
+				profiler_reset();
+			else if (value == 2)
+				benchmark_format();
+			else if (value == 3 && !OUTPUT_FRAMED())
+			{
+				test_acquisition_deadlines(sensor, 10);
+				return restart_acquisition(sensor);
+			}
+			else
+				return 1;
+			return 0;
+#endif
+		default:
+			return 1;
+	}
+}
+
+static void store_setting(const Command_t* command)
+//Saves an applied command's setting, if it's one that's kept
+{
+	for (uint8_t key = 0; key < sizeof(stored_commands); key++)
+	{
+		if (stored_commands[key] == command->letter)
+			config_store_set(key, (uint32_t)command->value);
+	}
+}
+
+static void load_settings(MS56XX_t* sensor)
+//Replays the stored settings through apply_command, so they're checked the same way a ground station command is
+{
+	Command_t command = {.has_value = 1};
+	uint32_t value;
+	config_store_init();
+	for (uint8_t key = 0; key < sizeof(stored_commands); key++)
+	{
+		if (config_store_get(key, &value) == 0)
+		{
+			command.letter = stored_commands[key];
+			command.value = (int32_t)value;
+			apply_command(&command, sensor); //A value that no longer makes sense is just left at the default
+		}
+	}
+}
+
+static uint8_t restart_acquisition(MS56XX_t* sensor)
+//Applies the current settings to the timer driven sensor reads
+{
+	if (settings.sensors & SENSOR_PRESSURE)
+		return acquisition_start(sensor, settings.sample_period_ms);
+	acquisition_stop();
+	return 0;
+}
+
+static void poll_commands(CommandParser_t* parser, MS56XX_t* sensor)
+//Handles every command that has arrived since the last call
+{
+	uint8_t received[8];
+	uint16_t length;
+	Command_t command;
+	while ((length = UART_read(received, sizeof(received))) != 0)
+	{
+		for (uint16_t i = 0; i < length; i++)
+		{
+			if (command_parser_push(parser, received[i], &command))
+			{
+				uint8_t status = apply_command(&command, sensor);
+				if (status == 0)
+					store_setting(&command);
+				send_ack(command.letter, status);
+			}
+		}
+	}
+}
+
+//-------------Main loop tasks-------------
+
+static void run_acquisition(void* sensor)
+//Picks up a finished sample and releases the tasks that use it
+{
+	PROFILE_BEGIN(PROFILE_ACQUISITION_READ);
+	uint8_t have_sample = acquisition_read(sensor);
+	PROFILE_END(PROFILE_ACQUISITION_READ);
+	if (!have_sample)
+		return;
+	sample_active_percent = ((MS56XX_t*)sensor)->data.active_percent;
+	task_scheduler_schedule(&tasks, task_filter, 0);
+	task_scheduler_schedule(&tasks, task_log, 0);
+	task_scheduler_schedule(&tasks, task_telemetry, 0);
+}
+
+static void run_filter(void* sensor)
+//Windowed pressure statistics for the status frame
+{
+	if (((MS56XX_t*)sensor)->data.valid)
+		rb32agg_push(&pressure_window, ((MS56XX_t*)sensor)->data.pressure);
+}
+
+static void run_log(void* sensor)
+{
+	TelemetrySample_t sample;
+	make_sample(sensor, &sample);
+	PROFILE_BEGIN(PROFILE_FLASHLOG_APPEND);
+	flashlog_append(&sample); //Drops samples once the log is full
+	PROFILE_END(PROFILE_FLASHLOG_APPEND);
+}
+
+static void run_telemetry(void* sensor)
+{
+	PROFILE_BEGIN(PROFILE_SEND_SAMPLE);
+	send_sample(sensor);
+	PROFILE_END(PROFILE_SEND_SAMPLE);
+}
+
+static void run_commands(void* sensor)
+{
+	PROFILE_BEGIN(PROFILE_POLL_COMMANDS);
+	poll_commands(&parser, sensor);
+	PROFILE_END(PROFILE_POLL_COMMANDS);
+}
+
+static void run_readout(void* unused)
+//One-shot, released by the L1 command. Comes back later for as long as there is more to send
+{
+	continue_readout();
+	if (readout_active)
+		task_scheduler_schedule(&tasks, task_readout, READOUT_RETRY_US);
+}
+
+static void run_report(void* unused)
+//One-shot, released by start_report (T0, Q0). Sends the next row, or tries the same one again later if the link turned it down
+{
+	if (report_row >= report_rows)
+		return;
+	if (!report_send_row(report_row))
+	{
+		task_scheduler_schedule(&tasks, task_report, REPORT_RETRY_US);
+		return;
+	}
+	if (++report_row < report_rows)
+		task_scheduler_schedule(&tasks, task_report, 0);
+}
+
+static void run_status(void* unused)
+{
+	send_status();
+}
 
 //Example usage of MS5611/07 driver for One Monthers
 int main (void)
 {
 	board_init();
 	sysclk_init();
+	pmic_init(); //Levels are planned in conf_interrupts.h
+	pmic_set_scheduling(PMIC_SCH_ROUND_ROBIN); //So a busy UART can't starve the timebase at low level
+	timebase_init(); //First, so everything after can timestamp
+	profiler_init();
 
 	UART_computer_init(&COMMS_USART, &PORTC, USART_TX_PIN, USART_RX_PIN);
+	UART_tx_dma_init(&COMMS_USART, true); //printf now returns as soon as the text is queued. UART_tx_interrupt_init if the DMA channel is needed elsewhere
+	UART_rx_interrupt_init(&COMMS_USART);
 
 	PORTE.DIR = 0xff;
 	PORTE.OUT = 0x0f;
 	
-	MS56XX_t pressure_sensor = define_new_MS56XX_default_OSR(MS5607, &SPIC, PRESSURE_SELECT_PIN);
+	MS56XX_t pressure_sensor = define_new_MS56XX(MS5607, &SPIC, settings.pressure_select_pin, settings.osr);
 	
 	initializespi(&SPIC, &PORTC);
 	enable_select_pin(pressure_sensor.select_pin);
@@ -29,14 +694,41 @@ int main (void)
 	//Pressure sensor initialization routine, also reads calibration data from sensor
 	calibratePressureSensor(&pressure_sensor);
 	
-	readMS56XX(&pressure_sensor);
-
-	printf("Pressure is %" PRIi32 ", temperature is %" PRIi32 "\n", pressure_sensor.data.pressure, pressure_sensor.data.temperature);
+	flashlog_init();
+	
+	command_parser_init(&parser);
+	delta_encoder_init(&delta_encoder, 0); //Keyframes come from the start of each frame instead
+	
+	//Reserve one full frame of headroom per priority level below the samples
+	telemetry_scheduler_init(&scheduler, settings.baudrate, USART_SERIAL_TX_BUFFER_SIZE, TELEMETRY_MAX_FRAME, timebase_ms());
+	channel_samples = telemetry_scheduler_add_channel(&scheduler, PRIORITY_SAMPLES, 0, 1);
+	channel_acks = telemetry_scheduler_add_channel(&scheduler, PRIORITY_ACKS, 0, 0); //Every ack and report matters
+	channel_status = telemetry_scheduler_add_channel(&scheduler, PRIORITY_STATUS, STATUS_PERIOD_MS, 1);
+	channel_readout = telemetry_scheduler_add_channel(&scheduler, PRIORITY_READOUT, 0, 0); //Resent from where it stopped, see continue_readout
+	
+	rb32agg_init(&pressure_window, pressure_window_array, pressure_min_queue, pressure_max_queue, FILTER_WINDOW + 1);
+	
+	//Registered in priority order: the earlier task runs first when two are due at once
+	task_scheduler_init(&tasks, timebase_us);
+	task_scheduler_add(&tasks, "acquisition", run_acquisition, &pressure_sensor, POLL_PERIOD_US);
+	task_filter = task_scheduler_add(&tasks, "filter", run_filter, &pressure_sensor, 0);
+	task_log = task_scheduler_add(&tasks, "log", run_log, &pressure_sensor, 0);
+	task_telemetry = task_scheduler_add(&tasks, "telemetry", run_telemetry, &pressure_sensor, 0);
+	task_scheduler_add(&tasks, "commands", run_commands, &pressure_sensor, POLL_PERIOD_US);
+	task_readout = task_scheduler_add(&tasks, "readout", run_readout, NULL, 0);
+	task_report = task_scheduler_add(&tasks, "report", run_report, NULL, 0);
+	task_scheduler_add(&tasks, "status", run_status, NULL, STATUS_PERIOD_MS * 1000UL);
+	
+	//Settings changed from the ground on earlier runs, replayed once everything the commands act on is set up.
+	//A stored select pin calibrates again from that sensor, a stored baud rate moves the scheduler's budget with it
+	load_settings(&pressure_sensor);
 	
+	//Sample timing is the acquisition timer's from here on; the tasks only pick finished samples up
+	restart_acquisition(&pressure_sensor);
 	while (1)
 	{
-		readMS56XX(&pressure_sensor);
-		printf("Pressure is %" PRIi32 ", temperature is %" PRIi32 ", %s\n", pressure_sensor.data.pressure, pressure_sensor.data.temperature, pressure_sensor.data.valid ? "Valid" : "Not valid");
-		delay_ms(1000);
+		//Sleeps between tasks, so this is where the power goes down
+		if (!task_scheduler_run(&tasks))
+			timebase_sleep_us(task_scheduler_idle_us(&tasks));
 	}
 }